@@ -4,7 +4,7 @@
 #include <inviwo/core/datastructures/image/layerramprecision.h>
 #include <inviwo/core/util/indexmapper.h>
 #include <inviwo/core/util/imageramutils.h>
-
+#include <inviwo/core/util/formatdispatching.h>
 
 namespace inviwo {
 
@@ -32,7 +32,10 @@ ImageMappingCPU::ImageMappingCPU()
                FloatVec4Property{"color7", "Color 7", vec4(1), vec4(0, 0, 0, 1), vec4(1)},
                FloatVec4Property{"color8", "Color 8", vec4(1), vec4(0, 0, 0, 1), vec4(1)},
                FloatVec4Property{"color9", "Color 9", vec4(1), vec4(0, 0, 0, 1), vec4(1)},
-               FloatVec4Property{"color10", "Color 10", vec4(1), vec4(0, 0, 0, 1), vec4(1)}}) {
+               FloatVec4Property{"color10", "Color 10", vec4(1), vec4(0, 0, 0, 1), vec4(1)}})
+    , useLookupTable_("useLookupTable", "Use Lookup Table", true)
+    , lookupTableSize_("lookupTableSize", "Lookup Table Size", 1024, 2, 65536)
+    , outputPoolStatistics_("outputPoolStatistics", "Output Images", "", InvalidationLevel::Valid) {
 
     addPort(inport_);
     addPort(outport_);
@@ -43,6 +46,11 @@ ImageMappingCPU::ImageMappingCPU()
         c.setCurrentStateAsDefault();
         addProperty(c);
     }
+    addProperty(useLookupTable_);
+    addProperty(lookupTableSize_);
+    outputPoolStatistics_.setReadOnly(true);
+    outputPoolStatistics_.setSerializationMode(PropertySerializationMode::None);
+    addProperty(outputPoolStatistics_);
 
     auto colorVisibility = [&]() {
         for (size_t i = 0; i < 10; i++) {
@@ -56,7 +64,9 @@ ImageMappingCPU::ImageMappingCPU()
 
 void ImageMappingCPU::process() {
     auto inImg = inport_.getData();
-    auto img = std::make_shared<Image>(inImg->getDimensions(), DataVec4UInt8::get());
+    auto img = outputPool_.get(inImg->getDimensions(), [&]() {
+        return std::make_shared<Image>(inImg->getDimensions(), DataVec4UInt8::get());
+    });
     auto outRep = static_cast<LayerRAMPrecision<glm::u8vec4>*>(
         img->getColorLayer()->getEditableRepresentation<LayerRAM>());
     glm::u8vec4* outPixels = outRep->getDataTyped();
@@ -66,17 +76,42 @@ void ImageMappingCPU::process() {
     for (size_t i = 0; i < numColors_.get(); i++) {
         map.addBaseColors(colors_[i].get());
     }
+    if (useLookupTable_) {
+        map.bake(lookupTableSize_.get());
+    }
 
     inImg->getColorLayer()->getRepresentation<LayerRAM>()->dispatch<void>([&](const auto inRep) {
+        using ValueType = util::PrecisionValueType<decltype(inRep)>;
         auto inPixels = inRep->getDataTyped();
-        util::forEachPixelParallel(*inRep, [&](size2_t pos) {
-            auto i = index(pos);
-            float inPixelVal = util::glm_convert_normalized<float>(inPixels[i]);
-            outPixels[i] = map.sample(inPixelVal) * 255.f;
-        });
+        if (!map.isBaked()) {
+            // One job per row, each row is normalized and then mapped in a single batch
+            const size2_t dims = inRep->getDimensions();
+            util::forEachPixelParallel(size2_t(1, dims.y), [&](size2_t pos) {
+                thread_local std::vector<float> values;
+                values.resize(dims.x);
+                const size_t rowStart = index(size2_t(0, pos.y));
+                for (size_t x = 0; x < dims.x; ++x) {
+                    values[x] = util::glm_convert_normalized<float>(inPixels[rowStart + x]);
+                }
+                map.sample(values, util::span<glm::u8vec4>(outPixels + rowStart, dims.x));
+            });
+        } else if constexpr (std::is_same_v<ValueType, glm::u8>) {
+            // 8-bit values index the byte table directly, no normalization needed
+            const auto& table = map.getByteTable();
+            util::forEachPixelParallel(*inRep, [&](size2_t pos) {
+                auto i = index(pos);
+                outPixels[i] = table[inPixels[i]];
+            });
+        } else {
+            util::forEachPixelParallel(*inRep, [&](size2_t pos) {
+                auto i = index(pos);
+                outPixels[i] = map.lookup(util::glm_convert_normalized<float>(inPixels[i]));
+            });
+        }
     });
 
     outport_.setData(img);
+    outputPoolStatistics_.set(outputPool_.statistics());
 }
 
 }  // namespace inviwo
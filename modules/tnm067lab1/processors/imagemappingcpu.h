@@ -3,7 +3,10 @@
 #include <modules/tnm067lab1/tnm067lab1moduledefine.h>
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
 #include <inviwo/core/ports/imageport.h>
+#include <modules/tnm067lab1/utils/outputpool.h>
 
 namespace inviwo {
 
@@ -23,6 +26,12 @@ private:
 
     IntSizeTProperty numColors_;
     std::array<FloatVec4Property, 10> colors_;
+
+    BoolProperty useLookupTable_;
+    IntSizeTProperty lookupTableSize_;
+
+    TNM067::OutputPool<Image, size2_t> outputPool_;  // Output images by dimensions
+    StringProperty outputPoolStatistics_;
 };
 
 }  // namespace inviwo
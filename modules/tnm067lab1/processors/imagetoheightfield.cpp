@@ -1,7 +1,19 @@
 #include <modules/tnm067lab1/processors/imagetoheightfield.h>
 #include <modules/tnm067lab1/utils/scalartocolormapping.h>
+#include <modules/tnm067lab1/utils/parallelfor.h>
 #include <inviwo/core/util/imageramutils.h>
+#include <inviwo/core/util/glmutils.h>
 #include <inviwo/core/datastructures/image/layerram.h>
+#include <inviwo/core/datastructures/image/layerramprecision.h>
+#include <inviwo/core/datastructures/buffer/buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace inviwo {
 
@@ -19,6 +31,7 @@ namespace inviwo {
         : Processor()
         , imageInport_("imageInport", true)
         , meshOutport_("meshOutport")
+        , chunkOutport_("chunkOutport")
         , heightScaleFactor_("heightScaleFactor", "Height Scale Factor", 1.0f, 0.001f, 2.0f, 0.001f)
         , numColors_("numColors", "Number of colors", 2, 1, 10)
         , colors_(
@@ -31,11 +44,26 @@ namespace inviwo {
             FloatVec4Property{ "color7", "Color 7", util::ordinalColor(1.0f, 1.0f, 1.0f, 1.0f) },
             FloatVec4Property{ "color8", "Color 8", util::ordinalColor(1.0f, 1.0f, 1.0f, 1.0f) },
             FloatVec4Property{ "color9", "Color 9", util::ordinalColor(1.0f, 1.0f, 1.0f, 1.0f) },
-            FloatVec4Property{ "color10", "Color 10", util::ordinalColor(1.0f, 1.0f, 1.0f, 1.0f) } }) {
+            FloatVec4Property{ "color10", "Color 10", util::ordinalColor(1.0f, 1.0f, 1.0f, 1.0f) } })
+        , meshMode_("meshMode", "Mesh Mode",
+                    { { "boxes", "Boxes", MeshMode::Boxes },
+                    { "compact", "Compact (top faces and visible walls)", MeshMode::Compact },
+                    { "greedy", "Greedy (merge equal neighbours)", MeshMode::Greedy } },
+                    0)
+        , mergeTolerance_("mergeTolerance", "Merge Tolerance", 0.0f, 0.0f, 1.0f, 0.001f)
+        , chunked_("chunked", "Chunked Output", false)
+        , chunkSize_("chunkSize", "Chunk Size", 1024, 16, 8192)
+        , keepChunks_("keepChunks", "Keep All Chunks", true) {
 
         addPort(imageInport_);
         addPort(meshOutport_);
+        addPort(chunkOutport_);
         addProperty(heightScaleFactor_);
+        addProperty(meshMode_);
+        addProperty(mergeTolerance_);
+        addProperty(chunked_);
+        addProperty(chunkSize_);
+        addProperty(keepChunks_);
 
         addProperty(numColors_);
         for (auto& c : colors_) {
@@ -50,13 +78,50 @@ namespace inviwo {
 
         numColors_.onChange(colorVisibility);
         colorVisibility();
+
+        auto toleranceVisibility = [&]() {
+            mergeTolerance_.setVisible(meshMode_ == MeshMode::Greedy);
+        };
+        meshMode_.onChange(toleranceVisibility);
+        toleranceVisibility();
+
+        auto chunkVisibility = [&]() {
+            chunkSize_.setVisible(chunked_);
+            keepChunks_.setVisible(chunked_);
+        };
+        chunked_.onChange(chunkVisibility);
+        chunkVisibility();
     }
 
     namespace {
-        using HFMesh = TypedMesh<buffertraits::PositionsBuffer, buffertraits::NormalBuffer,
-            buffertraits::ColorsBuffer>;
+        /**
+         * Vertex attributes of a mesh being built. addVertices moves them into the buffers of the
+         * mesh without copying.
+         */
+        struct Vertices {
+            std::vector<vec3> positions;
+            std::vector<vec3> normals;
+            std::vector<vec4> colors;
+
+            size_t size() const { return positions.size(); }
+            void resize(size_t size) {
+                positions.resize(size);
+                normals.resize(size);
+                colors.resize(size);
+            }
+            void emplace_back(const vec3& position, const vec3& normal, const vec4& color) {
+                positions.push_back(position);
+                normals.push_back(normal);
+                colors.push_back(color);
+            }
+            void set(size_t i, const vec3& position, const vec3& normal, const vec4& color) {
+                positions[i] = position;
+                normals[i] = normal;
+                colors[i] = color;
+            }
+        };
 
-        void addFace(std::vector<HFMesh::Vertex>& vertices, std::vector<unsigned int>& indices,
+        void addFace(Vertices& vertices, std::vector<unsigned int>& indices,
                      const vec3& c1, const vec3& c2, const vec3& c3, const vec3& c4, const vec3& normal,
                      const vec4& color) {
 
@@ -70,62 +135,521 @@ namespace inviwo {
                            { startID + 0, startID + 1, startID + 2, startID + 0, startID + 2, startID + 3 });
         }
 
-        std::shared_ptr<Mesh> buildMesh(const LayerRAM& image, const ScalarToColorMapping& map,
-                                        float scaleFactor) {
-            const auto dims = image.getDimensions();
+        // Box Normals
+        constexpr auto down = vec3(0.0f, -1.0f, 0.0f);
+        constexpr auto up = vec3(0.0f, 1.0f, 0.0f);
+        constexpr auto left = vec3(-1.0f, 0.0f, 0.0f);
+        constexpr auto right = vec3(1.0f, 0.0f, 0.0f);
+        constexpr auto front = vec3(0.0f, 0.0f, -1.0f);
+        constexpr auto back = vec3(0.0f, 0.0f, 1.0f);
+
+        /**
+         * Wall in the plane x = const between a column of height h0 (smaller x) and one of height
+         * h1, facing and colored as the side of the taller column. Nothing if they are equal.
+         */
+        void addWallX(Vertices& vertices, std::vector<unsigned int>& indices,
+                      float x, float z0, float z1, float h0, float h1, const vec4& color0,
+                      const vec4& color1) {
+            if (h1 > h0) {
+                addFace(vertices, indices, vec3(x, h0, z0), vec3(x, h0, z1), vec3(x, h1, z1),
+                        vec3(x, h1, z0), left, color1);
+            } else if (h0 > h1) {
+                addFace(vertices, indices, vec3(x, h1, z0), vec3(x, h1, z1), vec3(x, h0, z1),
+                        vec3(x, h0, z0), right, color0);
+            }
+        }
+
+        /**
+         * Wall in the plane z = const between a column of height h0 (smaller z) and one of height
+         * h1, facing and colored as the side of the taller column. Nothing if they are equal.
+         */
+        void addWallZ(Vertices& vertices, std::vector<unsigned int>& indices,
+                      float z, float x0, float x1, float h0, float h1, const vec4& color0,
+                      const vec4& color1) {
+            if (h1 > h0) {
+                addFace(vertices, indices, vec3(x0, h0, z), vec3(x1, h0, z), vec3(x1, h1, z),
+                        vec3(x0, h1, z), front, color1);
+            } else if (h0 > h1) {
+                addFace(vertices, indices, vec3(x0, h1, z), vec3(x1, h1, z), vec3(x1, h0, z),
+                        vec3(x0, h0, z), back, color0);
+            }
+        }
+
+        // Writes a face into preallocated buffers, same layout as addFace
+        void writeFace(Vertices& vertices, unsigned int* indices, unsigned int startID,
+                       const vec3& c1, const vec3& c2, const vec3& c3, const vec3& c4,
+                       const vec3& normal, const vec4& color) {
+            vertices.set(startID + 0, c1, normal, color);
+            vertices.set(startID + 1, c2, normal, color);
+            vertices.set(startID + 2, c3, normal, color);
+            vertices.set(startID + 3, c4, normal, color);
+
+            indices[0] = startID + 0;
+            indices[1] = startID + 1;
+            indices[2] = startID + 2;
+            indices[3] = startID + 0;
+            indices[4] = startID + 2;
+            indices[5] = startID + 3;
+        }
+
+        /**
+         * Dispatches once on the format of the layer and calls func with a function returning the
+         * value of a pixel (x, y). Like LayerRAM::getAsDouble the value is the first component,
+         * not normalized.
+         */
+        template <typename Func>
+        void dispatchPixelReader(const LayerRAM& image, Func&& func) {
+            image.dispatch<void>([&](const auto rep) {
+                const auto data = rep->getDataTyped();
+                const size_t width = rep->getDimensions().x;
+                func([data, width](size_t x, size_t y) {
+                    return static_cast<float>(util::glmcomp(data[x + y * width], 0));
+                });
+            });
+        }
+
+        /**
+         * Smallest and largest value of the image, computed in parallel over the rows. Skips the
+         * remaining rows once stop is set.
+         */
+        template <typename Reader>
+        std::pair<float, float> valueRange(const Reader& pixelValue, size2_t dims,
+                                           const TNM067::BackgroundJob::Stop& stop) {
+            std::vector<std::pair<float, float>> rows(dims.y);
+            TNM067::parallelFor(dims.y, [&](size_t y) {
+                auto& [min, max] = rows[y];
+                min = std::numeric_limits<float>::max();
+                max = std::numeric_limits<float>::lowest();
+                if (stop) return;
+                for (size_t x = 0; x < dims.x; ++x) {
+                    const float value = pixelValue(x, y);
+                    min = std::min(min, value);
+                    max = std::max(max, value);
+                }
+            });
+            std::pair<float, float> range{0.0f, 0.0f};
+            if (!rows.empty()) range = rows.front();
+            for (const auto& [min, max] : rows) {
+                range.first = std::min(range.first, min);
+                range.second = std::max(range.second, max);
+            }
+            return range;
+        }
+
+        /**
+         * Pixel range [begin, end) of the image to build a mesh for. Chunks are built with
+         * localCoordinates, see addVertices.
+         */
+        struct Region {
+            size2_t begin;
+            size2_t end;
+            bool localCoordinates;
+        };
+
+        /**
+         * Moves the vertices into the buffers of the mesh. With local coordinates, the basis and
+         * offset of the mesh are set to the bounding box of the vertices, and the vertices are
+         * moved into the [0,1] coordinates of that box.
+         */
+        void addVertices(Mesh& mesh, Vertices&& vertices, bool localCoordinates) {
+            auto& positions = vertices.positions;
+            if (localCoordinates && !positions.empty()) {
+                vec3 min{std::numeric_limits<float>::max()};
+                vec3 max{std::numeric_limits<float>::lowest()};
+                for (const auto& position : positions) {
+                    min = glm::min(min, position);
+                    max = glm::max(max, position);
+                }
+                const vec3 extent = glm::max(max - min, vec3(std::numeric_limits<float>::min()));
+                for (auto& position : positions) {
+                    position = (position - min) / extent;
+                }
+                mesh.setBasis(mat3(vec3(extent.x, 0.0f, 0.0f), vec3(0.0f, extent.y, 0.0f),
+                                   vec3(0.0f, 0.0f, extent.z)));
+                mesh.setOffset(min);
+            }
+            mesh.addBuffer(BufferType::PositionAttrib, util::makeBuffer(std::move(positions)));
+            mesh.addBuffer(BufferType::NormalAttrib, util::makeBuffer(std::move(vertices.normals)));
+            mesh.addBuffer(BufferType::ColorAttrib, util::makeBuffer(std::move(vertices.colors)));
+        }
 
-            auto mesh = std::make_shared<HFMesh>();
+        /**
+         * A closed box per pixel. Every pixel writes a fixed number of vertices and indices, so
+         * the rows are built in parallel directly into the preallocated buffers. Like the other
+         * builders, skips the remaining rows and returns null once stop is set.
+         */
+        template <typename Reader>
+        std::shared_ptr<Mesh> buildBoxMesh(const Reader& pixelValue, size2_t dims,
+                                           const Region& region, const ScalarToColorMapping& map,
+                                           float scaleFactor,
+                                           const TNM067::BackgroundJob::Stop& stop) {
+            constexpr size_t verticesPerPixel = 24;
+            constexpr size_t indicesPerPixel = 36;
+
+            const size2_t size = region.end - region.begin;
+
+            auto mesh = std::make_shared<Mesh>();
             auto& indices =
                 mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)->getDataContainer();
 
-            std::vector<HFMesh::Vertex> vertices;
+            Vertices vertices;
+            vertices.resize(verticesPerPixel * size.x * size.y);
+            indices.resize(indicesPerPixel * size.x * size.y);
 
-            const auto bufferSize = 24 * dims.x * dims.y;
-            indices.reserve(bufferSize);
-            vertices.reserve(bufferSize);
+            const vec2 cellSize = 1.0f / vec2(dims);
+
+            TNM067::parallelFor(size.y, [&](size_t row) {
+                if (stop) return;
+                const size_t y = region.begin.y + row;
+
+                // Image values and colors of the row, the colors are mapped in one batch
+                thread_local std::vector<float> rowValues;
+                thread_local std::vector<vec4> rowColors;
+                rowValues.resize(size.x);
+                rowColors.resize(size.x);
+                for (size_t i = 0; i < size.x; ++i) {
+                    rowValues[i] = pixelValue(region.begin.x + i, y);
+                }
+                map.sample(rowValues, rowColors);
+
+                for (size_t i = 0; i < size.x; ++i) {
+                    const vec2 origin2D = vec2(region.begin.x + i, y) * cellSize;
+                    const vec3 origin(origin2D.x, 0.0f, origin2D.y);
+
+                    const float imageValue = rowValues[i];
+                    const vec4 color = rowColors[i];
+
+                    const float height = imageValue * scaleFactor;
+
+                    // Box Corners
+                    const auto zero = origin + vec3(0.0f, 0.0f, 0.0f);
+                    const auto px = origin + vec3(cellSize.x, 0.0f, 0.0f);
+                    const auto pz = origin + vec3(0.0f, 0.0f, cellSize.y);
+                    const auto py = origin + vec3(0.0f, height, 0.0f);
+                    const auto pxpy = origin + vec3(cellSize.x, height, 0.0f);
+                    const auto pxpz = origin + vec3(cellSize.x, 0.0f, cellSize.y);
+                    const auto pypz = origin + vec3(0.0f, height, cellSize.y);
+                    const auto pxpypz = origin + vec3(cellSize.x, height, cellSize.y);
+
+                    const size_t pixel = i + row * size.x;
+                    unsigned int* idx = indices.data() + pixel * indicesPerPixel;
+                    auto id = static_cast<unsigned int>(pixel * verticesPerPixel);
+
+                    // Bottom, top, left, right, front and back face
+                    writeFace(vertices, idx + 0, id + 0, zero, px, pxpz, pz, down, color);
+                    writeFace(vertices, idx + 6, id + 4, py, pxpy, pxpypz, pypz, up, color);
+                    writeFace(vertices, idx + 12, id + 8, zero, pz, pypz, py, left, color);
+                    writeFace(vertices, idx + 18, id + 12, px, pxpz, pxpypz, pxpy, right, color);
+                    writeFace(vertices, idx + 24, id + 16, zero, px, pxpy, py, front, color);
+                    writeFace(vertices, idx + 30, id + 20, pz, pxpz, pxpypz, pypz, back, color);
+                }
+            });
+            if (stop) return nullptr;
+
+            addVertices(*mesh, std::move(vertices), region.localCoordinates);
+
+            return mesh;
+        }
+
+        /**
+         * Heightfield with only the top face of each column and the visible walls between
+         * neighbouring columns of different height. Outside of the image the height is zero. Top
+         * faces of neighbouring pixels with the same height and color share vertices.
+         * Walls towards the pixels left of and before the region are part of the region, walls at
+         * its right and back side only at the border of the image.
+         */
+        template <typename Reader>
+        std::shared_ptr<Mesh> buildCompactMesh(const Reader& pixelValue, size2_t dims,
+                                               const Region& region,
+                                               const ScalarToColorMapping& map,
+                                               float scaleFactor,
+                                               const TNM067::BackgroundJob::Stop& stop) {
+            auto mesh = std::make_shared<Mesh>();
+            auto& indices =
+                mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)->getDataContainer();
+
+            Vertices vertices;
 
             const vec2 cellSize = 1.0f / vec2(dims);
-            util::forEachPixel(image, [&] (const size2_t& pos) {
-                const vec2 origin2D = vec2(pos) * cellSize;
-                const vec3 origin(origin2D.x, 0.0f, origin2D.y);
-
-                // TODO: sample image
-                // const float imageValue = 0.0f;
-                const float imageValue = image.getAsDouble(pos);
-
-
-                const vec4 color = map.sample(imageValue);
-                // vec4(0.4f, 0.5f, 0.6f, 1.0f);
-
-                const float height = imageValue * scaleFactor;  // Is this heightScaleFactor_?
-
-                // Box Corners
-                const auto zero = origin + vec3(0.0f, 0.0f, 0.0f);
-                const auto px = origin + vec3(cellSize.x, 0.0f, 0.0f);
-                const auto pz = origin + vec3(0.0f, 0.0f, cellSize.y);
-                const auto py = origin + vec3(0.0f, height, 0.0f);
-                const auto pxpy = origin + vec3(cellSize.x, height, 0.0f);
-                const auto pxpz = origin + vec3(cellSize.x, 0.0f, cellSize.y);
-                const auto pypz = origin + vec3(0.0f, height, cellSize.y);
-                const auto pxpypz = origin + vec3(cellSize.x, height, cellSize.y);
-
-                // Box Normals
-                constexpr auto down = vec3(0.0f, -1.0f, 0.0f);
-                constexpr auto up = vec3(0.0f, 1.0f, 0.0f);
-                constexpr auto left = vec3(-1.0f, 0.0f, 0.0f);
-                constexpr auto right = vec3(1.0f, 0.0f, 0.0f);
-                constexpr auto front = vec3(0.0f, 0.0f, -1.0f);
-                constexpr auto back = vec3(0.0f, 0.0f, 1.0f);
-
-                addFace(vertices, indices, zero, px, pxpz, pz, down, color);       // Bottom face
-                addFace(vertices, indices, py, pxpy, pxpypz, pypz, up, color);     // Top face
-                addFace(vertices, indices, zero, pz, pypz, py, left, color);       // Left face
-                addFace(vertices, indices, px, pxpz, pxpypz, pxpy, right, color);  // Right face
-                addFace(vertices, indices, zero, px, pxpy, py, front, color);      // Front face
-                addFace(vertices, indices, pz, pxpz, pxpypz, pypz, back, color);   // Back face
-                               });
-
-            mesh->addVertices(vertices);
+            auto xPos = [&](size_t x) { return static_cast<float>(x) * cellSize.x; };
+            auto zPos = [&](size_t z) { return static_cast<float>(z) * cellSize.y; };
+
+            // Heights, colors and the indices of the four top face corners of a row of the
+            // region. Index 0 is the pixel left of the region, or the ground at the image border.
+            const size_t width = region.end.x - region.begin.x;
+            struct Row {
+                std::vector<float> heights;
+                std::vector<vec4> colors;
+                std::vector<std::array<unsigned int, 4>> top;
+            };
+            Row previous{std::vector<float>(width + 1, 0.0f), std::vector<vec4>(width + 1),
+                         std::vector<std::array<unsigned int, 4>>(width + 1)};
+            Row current = previous;
+
+            constexpr auto none = std::numeric_limits<unsigned int>::max();
+            std::vector<float> rowValues(width + 1);
+
+            auto readRow = [&](size_t y, Row& row) {
+                const size_t first = region.begin.x > 0 ? 0 : 1;
+                for (size_t i = first; i <= width; ++i) {
+                    rowValues[i] = pixelValue(region.begin.x + i - 1, y);
+                    row.heights[i] = rowValues[i] * scaleFactor;
+                }
+                map.sample(util::span<const float>(rowValues.data() + first, width + 1 - first),
+                           util::span<vec4>(row.colors.data() + first, width + 1 - first));
+                if (first == 1) {
+                    // The ground takes the color of the column, as its side faces the ground
+                    row.heights[0] = 0.0f;
+                    row.colors[0] = row.colors[1];
+                }
+            };
+            if (region.begin.y > 0) {
+                readRow(region.begin.y - 1, previous);
+            }
+
+            size2_t pos{0};
+            for (pos.y = region.begin.y; pos.y < region.end.y && !stop; ++pos.y) {
+                readRow(pos.y, current);
+                if (pos.y == 0) {
+                    previous.colors = current.colors;
+                }
+
+                const float z0 = zPos(pos.y);
+                const float z1 = zPos(pos.y + 1);
+                for (size_t i = 1; i <= width; ++i) {
+                    pos.x = region.begin.x + i - 1;
+                    const float height = current.heights[i];
+                    const vec4& color = current.colors[i];
+                    const float x0 = xPos(pos.x);
+                    const float x1 = xPos(pos.x + 1);
+
+                    // Top face, reuse the corners of the left and previous neighbour if possible
+                    auto& top = current.top[i];
+                    top.fill(none);
+                    if (i > 1 && current.heights[i - 1] == height &&
+                        current.colors[i - 1] == color) {
+                        top[0] = current.top[i - 1][1];
+                        top[3] = current.top[i - 1][2];
+                    }
+                    if (pos.y > region.begin.y && previous.heights[i] == height &&
+                        previous.colors[i] == color) {
+                        top[0] = previous.top[i][3];
+                        top[1] = previous.top[i][2];
+                    }
+                    const std::array<vec3, 4> corners{vec3(x0, height, z0), vec3(x1, height, z0),
+                                                      vec3(x1, height, z1), vec3(x0, height, z1)};
+                    for (size_t c = 0; c < 4; ++c) {
+                        if (top[c] == none) {
+                            top[c] = static_cast<unsigned int>(vertices.size());
+                            vertices.emplace_back(corners[c], up, color);
+                        }
+                    }
+                    indices.insert(indices.end(), {top[0], top[1], top[2], top[0], top[2], top[3]});
+
+                    // Walls towards the left and previous neighbours, or the ground at the border
+                    addWallX(vertices, indices, x0, z0, z1, current.heights[i - 1], height,
+                             current.colors[i - 1], color);
+                    if (pos.x + 1 == dims.x) {
+                        addWallX(vertices, indices, x1, z0, z1, height, 0.0f, color, color);
+                    }
+                    addWallZ(vertices, indices, z0, x0, x1, previous.heights[i], height,
+                             previous.colors[i], color);
+                    if (pos.y + 1 == dims.y) {
+                        addWallZ(vertices, indices, z1, x0, x1, height, 0.0f, color, color);
+                    }
+                }
+                std::swap(previous, current);
+            }
+            if (stop) return nullptr;
+
+            addVertices(*mesh, std::move(vertices), region.localCoordinates);
+
+            return mesh;
+        }
+
+        /**
+         * Merged values of the pixels next to a region of buildGreedyMesh: the column left of it,
+         * one value per row of the region, and the row before it, one value per column. Empty at
+         * the border of the image.
+         */
+        struct GreedyBorders {
+            std::vector<float> left;
+            std::vector<float> previous;
+        };
+
+        /**
+         * Greedy meshing of the compact heightfield. Starting from the first pixel not yet
+         * covered, in row order, a rectangle is grown first along x and then along z for as long
+         * as the pixels differ at most `tolerance` from the first one. All pixels of a rectangle
+         * take the value, and thereby the height and color, of its first pixel and share one top
+         * face. Walls between rows or columns of pixels are merged into one face as long as the
+         * heights and colors on both sides stay the same. The merged faces can meet with
+         * T-junctions.
+         *
+         * Walls are split between regions as in buildCompactMesh. The walls towards the left and
+         * previous region use the merged values of that region from borders, so they meet its top
+         * faces. On return, borders holds the merged values of the last column and row of this
+         * region, for the regions to the right of and after it.
+         */
+        template <typename Reader>
+        std::shared_ptr<Mesh> buildGreedyMesh(const Reader& pixelValue, size2_t dims,
+                                              const Region& region, const ScalarToColorMapping& map,
+                                              float scaleFactor, float tolerance,
+                                              GreedyBorders& borders,
+                                              const TNM067::BackgroundJob::Stop& stop) {
+            const size2_t size = region.end - region.begin;
+            const size_t numPixels = size.x * size.y;
+            std::vector<float> values(numPixels);
+            TNM067::parallelFor(size.y, [&](size_t y) {
+                if (stop) return;
+                for (size_t x = 0; x < size.x; ++x) {
+                    values[x + y * size.x] = pixelValue(region.begin.x + x, region.begin.y + y);
+                }
+            });
+
+            // The rectangle each pixel belongs to, given by the pixel range [begin, end) within
+            // the region
+            constexpr auto none = std::numeric_limits<size_t>::max();
+            std::vector<size_t> rectOf(numPixels, none);
+            std::vector<std::pair<size2_t, size2_t>> rects;
+            std::vector<float> rectValues;
+
+            for (size_t y = 0; y < size.y && !stop; ++y) {
+                for (size_t x = 0; x < size.x; ++x) {
+                    if (rectOf[x + y * size.x] != none) continue;
+
+                    const float value = values[x + y * size.x];
+                    auto mergeable = [&](size_t i) {
+                        return rectOf[i] == none && std::abs(values[i] - value) <= tolerance;
+                    };
+
+                    size2_t end{x + 1, y + 1};
+                    while (end.x < size.x && mergeable(end.x + y * size.x)) ++end.x;
+                    auto rowMergeable = [&](size_t row) {
+                        for (size_t i = x; i < end.x; ++i) {
+                            if (!mergeable(i + row * size.x)) return false;
+                        }
+                        return true;
+                    };
+                    while (end.y < size.y && rowMergeable(end.y)) ++end.y;
+
+                    for (size_t j = y; j < end.y; ++j) {
+                        const auto row = rectOf.begin() + j * size.x;
+                        std::fill(row + x, row + end.x, rects.size());
+                    }
+                    rects.emplace_back(size2_t{x, y}, end);
+                    rectValues.push_back(value);
+                }
+            }
+            if (stop) return nullptr;
+
+            std::vector<vec4> rectColors(rects.size());
+            map.sample(rectValues, rectColors);
+
+            auto mesh = std::make_shared<Mesh>();
+            auto& indices =
+                mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)->getDataContainer();
+
+            Vertices vertices;
+
+            const vec2 cellSize = 1.0f / vec2(dims);
+            auto xPos = [&](size_t x) { return static_cast<float>(x) * cellSize.x; };
+            auto zPos = [&](size_t z) { return static_cast<float>(z) * cellSize.y; };
+
+            for (size_t i = 0; i < rects.size(); ++i) {
+                const size2_t begin = region.begin + rects[i].first;
+                const size2_t end = region.begin + rects[i].second;
+                const float h = rectValues[i] * scaleFactor;
+                addFace(vertices, indices, vec3(xPos(begin.x), h, zPos(begin.y)),
+                        vec3(xPos(end.x), h, zPos(begin.y)), vec3(xPos(end.x), h, zPos(end.y)),
+                        vec3(xPos(begin.x), h, zPos(end.y)), up, rectColors[i]);
+            }
+
+            // Height and color of a pixel of the region, or of the pixels left of and before it
+            auto cell = [&](size2_t p) -> std::pair<float, vec4> {
+                float value;
+                if (p.x < region.begin.x) {
+                    value = borders.left[p.y - region.begin.y];
+                } else if (p.y < region.begin.y) {
+                    value = borders.previous[p.x - region.begin.x];
+                } else {
+                    const size2_t local = p - region.begin;
+                    const size_t rect = rectOf[local.x + local.y * size.x];
+                    return {rectValues[rect] * scaleFactor, rectColors[rect]};
+                }
+                return {value * scaleFactor, map.sample(value)};
+            };
+
+            // Heights and colors on both sides of a wall between two pixels. Outside of the image
+            // the height is zero and the color that of the pixel inside.
+            struct Wall {
+                float h0;
+                float h1;
+                vec4 c0;
+                vec4 c1;
+                bool operator==(const Wall& rhs) const {
+                    return h0 == rhs.h0 && h1 == rhs.h1 && c0 == rhs.c0 && c1 == rhs.c1;
+                }
+                bool operator!=(const Wall& rhs) const { return !(*this == rhs); }
+            };
+            auto wall = [&](std::optional<size2_t> p0, std::optional<size2_t> p1) {
+                const auto [h0, c0] = cell(p0 ? *p0 : *p1);
+                const auto [h1, c1] = cell(p1 ? *p1 : *p0);
+                return Wall{p0 ? h0 : 0.0f, p1 ? h1 : 0.0f, c0, c1};
+            };
+
+            // Walls in the planes x = const, merged along z
+            const size_t lastX = region.end.x == dims.x ? dims.x : region.end.x - 1;
+            for (size_t x = region.begin.x; x <= lastX && !stop; ++x) {
+                auto wallAt = [&](size_t y) {
+                    return wall(x > 0 ? std::optional<size2_t>({x - 1, y}) : std::nullopt,
+                                x < dims.x ? std::optional<size2_t>({x, y}) : std::nullopt);
+                };
+                size_t start = region.begin.y;
+                Wall current = wallAt(start);
+                for (size_t y = start + 1; y <= region.end.y; ++y) {
+                    const Wall next = y < region.end.y ? wallAt(y) : current;
+                    if (y == region.end.y || next != current) {
+                        addWallX(vertices, indices, xPos(x), zPos(start), zPos(y), current.h0,
+                                 current.h1, current.c0, current.c1);
+                        start = y;
+                        current = next;
+                    }
+                }
+            }
+
+            // Walls in the planes z = const, merged along x
+            const size_t lastY = region.end.y == dims.y ? dims.y : region.end.y - 1;
+            for (size_t y = region.begin.y; y <= lastY && !stop; ++y) {
+                auto wallAt = [&](size_t x) {
+                    return wall(y > 0 ? std::optional<size2_t>({x, y - 1}) : std::nullopt,
+                                y < dims.y ? std::optional<size2_t>({x, y}) : std::nullopt);
+                };
+                size_t start = region.begin.x;
+                Wall current = wallAt(start);
+                for (size_t x = start + 1; x <= region.end.x; ++x) {
+                    const Wall next = x < region.end.x ? wallAt(x) : current;
+                    if (x == region.end.x || next != current) {
+                        addWallZ(vertices, indices, zPos(y), xPos(start), xPos(x), current.h0,
+                                 current.h1, current.c0, current.c1);
+                        start = x;
+                        current = next;
+                    }
+                }
+            }
+
+            if (stop) return nullptr;
+
+            borders.left.resize(size.y);
+            for (size_t y = 0; y < size.y; ++y) {
+                borders.left[y] = rectValues[rectOf[size.x - 1 + y * size.x]];
+            }
+            borders.previous.resize(size.x);
+            for (size_t x = 0; x < size.x; ++x) {
+                borders.previous[x] = rectValues[rectOf[x + (size.y - 1) * size.x]];
+            }
+
+            addVertices(*mesh, std::move(vertices), region.localCoordinates);
 
             return mesh;
         }
@@ -133,16 +657,110 @@ namespace inviwo {
     }  // namespace
 
     void ImageToHeightfield::process() {
-        const auto layer = imageInport_.getData()->getColorLayer()->getRepresentation<LayerRAM>();
+        // Publish what the background build has finished since the last call. The previous
+        // result stays on the outports until the first part of the next one is done.
+        if (finishedMesh_) {
+            meshOutport_.setData(std::move(finishedMesh_));
+            chunkOutport_.clear();
+        }
+        if (newChunks_) {
+            chunkOutport_.setData(std::make_shared<std::vector<std::shared_ptr<Mesh>>>(chunks_));
+            meshOutport_.clear();
+            newChunks_ = false;
+            if (!keepChunks_) chunks_.clear();
+        }
+
+        const auto& properties = getProperties();
+        const bool changed =
+            imageInport_.isChanged() || std::any_of(properties.begin(), properties.end(),
+                                                    [](Property* p) { return p->isModified(); });
+        if (!changed) return;
 
         ScalarToColorMapping map;
         for (size_t i = 0; i < numColors_.get(); i++) {
             map.addBaseColors(colors_[i].get());
         }
 
-        const auto mesh = buildMesh(*layer, map, heightScaleFactor_);
-
-        meshOutport_.setData(mesh);
+        // The representation is created here, on the main thread
+        auto image = imageInport_.getData();
+        const LayerRAM* layer = image->getColorLayer()->getRepresentation<LayerRAM>();
+
+        job_.start(
+            [image, layer, map, meshMode = meshMode_.get(), scaleFactor = heightScaleFactor_.get(),
+             tolerance = mergeTolerance_.get(), chunked = chunked_.get(),
+             chunkSize = chunkSize_.get()](const TNM067::BackgroundJob::Stop& stop,
+                                           const auto& partial) -> std::shared_ptr<Mesh> {
+                std::shared_ptr<Mesh> mesh;
+                const auto dims = layer->getDimensions();
+                dispatchPixelReader(*layer, [&](const auto& pixelValue) {
+                    // The tolerance is relative to the values of the whole image, so that all
+                    // chunks merge alike
+                    float valueTolerance = 0.0f;
+                    if (meshMode == MeshMode::Greedy && tolerance > 0.0f) {
+                        const auto [min, max] = valueRange(pixelValue, dims, stop);
+                        valueTolerance = tolerance * (max - min);
+                    }
+                    auto build = [&](const Region& region,
+                                     GreedyBorders& borders) -> std::shared_ptr<Mesh> {
+                        switch (meshMode) {
+                            case MeshMode::Compact:
+                                return buildCompactMesh(pixelValue, dims, region, map,
+                                                        scaleFactor, stop);
+                            case MeshMode::Greedy:
+                                return buildGreedyMesh(pixelValue, dims, region, map,
+                                                       scaleFactor, valueTolerance, borders,
+                                                       stop);
+                            case MeshMode::Boxes:
+                            default:
+                                return buildBoxMesh(pixelValue, dims, region, map, scaleFactor,
+                                                    stop);
+                        }
+                    };
+
+                    if (!chunked) {
+                        GreedyBorders borders;
+                        mesh = build({size2_t(0), dims, false}, borders);
+                        return;
+                    }
+                    // One chunk at a time, each using the whole thread pool, so only the buffers
+                    // of a single chunk are being built at any time. Each chunk is handed over
+                    // as soon as it is done.
+                    const size2_t chunkSize2{chunkSize};
+                    const size2_t numChunks = (dims + chunkSize2 - size2_t(1)) / chunkSize2;
+                    // Last column of the previous chunk and last rows of the chunks above
+                    std::vector<float> left;
+                    std::vector<std::vector<float>> previousRows(numChunks.x);
+                    size_t index = 0;
+                    for (size_t y = 0; y < numChunks.y && !stop; ++y) {
+                        for (size_t x = 0; x < numChunks.x && !stop; ++x) {
+                            const size2_t begin = size2_t(x, y) * chunkSize2;
+                            GreedyBorders borders{x > 0 ? std::move(left) : std::vector<float>{},
+                                                  std::move(previousRows[x])};
+                            auto chunk =
+                                build({begin, glm::min(begin + chunkSize2, dims), true}, borders);
+                            left = std::move(borders.left);
+                            previousRows[x] = std::move(borders.previous);
+                            partial(std::make_pair(index++, std::move(chunk)));
+                        }
+                    }
+                });
+                return mesh;
+            },
+            [this](std::pair<size_t, std::shared_ptr<Mesh>> chunk) {
+                if (chunk.first == 0) chunks_.clear();
+                chunks_.push_back(std::move(chunk.second));
+                newChunks_ = true;
+                finishedMesh_.reset();
+                invalidate(InvalidationLevel::InvalidOutput);
+            },
+            [this](std::shared_ptr<Mesh> mesh) {
+                // Chunks have been handed over as they were done
+                if (!mesh) return;
+                finishedMesh_ = std::move(mesh);
+                chunks_.clear();
+                newChunks_ = false;
+                invalidate(InvalidationLevel::InvalidOutput);
+            });
     }
 
 }  // namespace inviwo
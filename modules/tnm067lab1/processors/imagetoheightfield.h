@@ -3,16 +3,32 @@
 #include <modules/tnm067lab1/tnm067lab1moduledefine.h>
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
 #include <inviwo/core/ports/imageport.h>
 #include <inviwo/core/ports/meshport.h>
 #include <modules/base/properties/gaussianproperty.h>
 #include <modules/tnm067lab1/utils/scalartocolormapping.h>
+#include <modules/tnm067lab1/utils/backgroundjob.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
 
+#include <memory>
+#include <vector>
+
 namespace inviwo {
 
 class IVW_MODULE_TNM067LAB1_API ImageToHeightfield : public Processor {
 public:
+    /**
+     * Boxes: a closed box per pixel, 24 vertices each.
+     * Compact: only the top faces and the visible walls between columns of different height,
+     * top faces share vertices with neighbours of the same height and color.
+     * Greedy: like Compact, but neighbouring pixels with values within mergeTolerance_ are merged
+     * into larger rectangles, and walls are merged along their edge. The tolerance is a fraction
+     * of the range of values in the image.
+     */
+    enum class MeshMode { Boxes, Compact, Greedy };
+
     ImageToHeightfield();
     virtual ~ImageToHeightfield() = default;
 
@@ -24,11 +40,34 @@ public:
 private:
     ImageInport imageInport_;
     MeshOutport meshOutport_;
+    /**
+     * Chunked output: the image is split into tiles of chunkSize_ pixels, each becoming a mesh of
+     * its own whose basis and offset are the bounding box of the chunk. A chunk of at most 8192^2
+     * pixels stays within 32-bit indices in every mesh mode. The chunks are published as they
+     * are done. With keepChunks_ the outport data grows until the whole image is covered, and
+     * the peak memory is that of the full mesh, as without chunks. Otherwise the outport only
+     * holds the chunks finished since it was last set, and consumers that need the whole surface
+     * accumulate them. The chunk at the origin of the image is always the first of a build.
+     */
+    DataOutport<std::vector<std::shared_ptr<Mesh>>> chunkOutport_;
     FloatProperty heightScaleFactor_;
+    TemplateOptionProperty<MeshMode> meshMode_;
+    FloatProperty mergeTolerance_;
+    BoolProperty chunked_;
+    IntSizeTProperty chunkSize_;
+    BoolProperty keepChunks_;
 
     IntSizeTProperty numColors_;
     std::array<FloatVec4Property, 10> colors_;
 
+    // Builds the mesh in the background, restarted when the image or a property changes
+    TNM067::BackgroundJob job_;
+    // The mesh of the last finished build, until it is on the outport
+    std::shared_ptr<Mesh> finishedMesh_;
+    // The chunks of the current build not on the outport yet, and with keepChunks_ also those
+    // that already are
+    std::vector<std::shared_ptr<Mesh>> chunks_;
+    bool newChunks_ = false;
 };
 
 }  // namespace inviwo
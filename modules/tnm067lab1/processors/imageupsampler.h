@@ -6,6 +6,11 @@
 #include <inviwo/core/ports/imageport.h>
 #include <modules/tnm067lab1/utils/scalartocolormapping.h>
 #include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
+#include <modules/tnm067lab1/utils/outputpool.h>
+
+#include <utility>
 
 namespace inviwo {
 
@@ -29,6 +34,14 @@ private:
 
     // Interpolation method
     TemplateOptionProperty<IntepolationMethod> interpolationMethod_;
+
+    BoolProperty parallel_;     // Process the output tiles in the thread pool
+    IntSizeTProperty tileSize_; // Width and height of the output tiles in pixels
+    BoolProperty fixedPoint_;   // Integer kernels for unsigned 8 and 16-bit images
+
+    // Output images by dimensions and data format
+    TNM067::OutputPool<Image, std::pair<size2_t, const DataFormatBase*>> outputPool_;
+    StringProperty outputPoolStatistics_;
 };
 
 }  // namespace inviwo
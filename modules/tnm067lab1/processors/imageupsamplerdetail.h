@@ -0,0 +1,303 @@
+#pragma once
+
+#include <modules/tnm067lab1/tnm067lab1moduledefine.h>
+#include <modules/tnm067lab1/processors/imageupsampler.h>
+#include <modules/tnm067lab1/utils/interpolationmethods.h>
+#include <modules/tnm067lab1/utils/parallelfor.h>
+#include <inviwo/core/datastructures/image/layerramprecision.h>
+#include <inviwo/core/util/glmutils.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace inviwo {
+
+    /**
+     * The resampling kernels of ImageUpsampler, in a header of their own so that they can also
+     * be instantiated outside of the processor, see tests/benchmarks/upsampling-benchmark.cpp.
+     */
+    namespace detail {
+
+        using Method = ImageUpsampler::IntepolationMethod;
+
+        /**
+         * Type used while interpolating pixels of type T, a scalar or glm vector of
+         * float_type<T> with the same number of components as T. All channels of a pixel are
+         * interpolated together.
+         */
+        template <typename T>
+        using accumulator_type =
+            typename util::same_extent<T, typename float_type<T>::type>::type;
+
+        template <Method M>
+        constexpr size_t numTaps() {
+            static_assert(M != Method::Barycentric, "Barycentric interpolation is not separable");
+            if constexpr (M == Method::PiecewiseConstant) {
+                return 1;
+            } else if constexpr (M == Method::Bilinear) {
+                return 2;
+            } else {
+                return 3;
+            }
+        }
+
+        /**
+         * Source indices and weights of a one dimensional resampling, one entry per output sample.
+         * Indices are clamped to the input range.
+         */
+        template <size_t Taps, typename F>
+        struct ResampleTable {
+            std::vector<std::array<size_t, Taps>> indices;
+            std::vector<std::array<F, Taps>> weights;
+        };
+
+        /**
+         * Builds the resampling table along one axis (0 = x, 1 = y) for a separable method, i.e.
+         * everything but Barycentric. Uses the same coordinates and weights as the per pixel
+         * interpolation.
+         */
+        template <Method M, typename F>
+        ResampleTable<numTaps<M>(), F> resampleTable(size2_t inputSize, size2_t outputSize,
+                                                     size_t axis) {
+            constexpr size_t taps = numTaps<M>();
+            ResampleTable<taps, F> table;
+            table.indices.resize(outputSize[axis]);
+            table.weights.resize(outputSize[axis]);
+
+            const auto maxIndex = static_cast<double>(inputSize[axis] - 1);
+            for (size_t i = 0; i < outputSize[axis]; ++i) {
+                const double c = ImageUpsampler::convertCoordinate(ivec2(static_cast<int>(i)),
+                                                                   inputSize, outputSize)[axis];
+                const double first =
+                    M == Method::PiecewiseConstant ? glm::round(c) : glm::floor(c);
+                for (size_t k = 0; k < taps; ++k) {
+                    table.indices[i][k] = static_cast<size_t>(
+                        glm::clamp(first + static_cast<double>(k), 0.0, maxIndex));
+                }
+
+                const F t = static_cast<F>(c - first);
+                if constexpr (M == Method::PiecewiseConstant) {
+                    table.weights[i] = {F(1)};
+                } else if constexpr (M == Method::Bilinear) {
+                    table.weights[i] = {F(1) - t, t};
+                } else {
+                    // Same weights as TNM067::Interpolation::quadratic at x = t / 2
+                    const F x = t / F(2);
+                    table.weights[i] = {(1 - x) * (1 - 2 * x), 4 * x * (1 - x), x * (2 * x - 1)};
+                }
+            }
+            return table;
+        }
+
+        /**
+         * Floating point arithmetic for the resampling, pixels are interpolated as
+         * accumulator_type<T> with float_type<T> weights.
+         */
+        template <typename T>
+        struct FloatingPointArithmetic {
+            using Weight = typename float_type<T>::type;
+            using Value = accumulator_type<T>;
+
+            template <Method M>
+            static auto table(size2_t inputSize, size2_t outputSize, size_t axis) {
+                return resampleTable<M, Weight>(inputSize, outputSize, axis);
+            }
+            static Value load(const T& v) { return static_cast<Value>(v); }
+            static Value horizontal(const Value& sum) { return sum; }
+            static T store(const Value& sum) { return static_cast<T>(sum); }
+
+            template <typename F>
+            static T barycentric(const std::array<T, 4>& v, F x, F y) {
+                const std::array<Value, 4> values{load(v[0]), load(v[1]), load(v[2]), load(v[3])};
+                return store(TNM067::Interpolation::barycentric(values, static_cast<Weight>(x),
+                                                                static_cast<Weight>(y)));
+            }
+        };
+
+        /**
+         * Integer arithmetic for unsigned 8 and 16-bit pixels, see
+         * TNM067::Interpolation::FixedPoint. The horizontal pass keeps extra fractional bits and
+         * the output is rounded to nearest.
+         */
+        template <typename T>
+        struct FixedPointArithmetic {
+            using Weight = TNM067::Interpolation::FixedPoint::Weight<T>;
+            using Value = TNM067::Interpolation::FixedPoint::accumulator<T>;
+
+            // Quantizes the floating point weights, see FixedPoint::quantizeWeights
+            template <Method M>
+            static auto table(size2_t inputSize, size2_t outputSize, size_t axis) {
+                constexpr size_t taps = numTaps<M>();
+
+                const auto source = resampleTable<M, double>(inputSize, outputSize, axis);
+                ResampleTable<taps, Weight> table;
+                table.indices = source.indices;
+                table.weights.resize(source.weights.size());
+                for (size_t i = 0; i < source.weights.size(); ++i) {
+                    table.weights[i] =
+                        TNM067::Interpolation::FixedPoint::quantizeWeights<T>(source.weights[i]);
+                }
+                return table;
+            }
+            static Value load(const T& v) { return static_cast<Value>(v); }
+            static Value horizontal(const Value& sum) {
+                return TNM067::Interpolation::FixedPoint::horizontal<T>(sum);
+            }
+            static T store(const Value& sum) {
+                return TNM067::Interpolation::FixedPoint::vertical<T>(sum);
+            }
+
+            template <typename F>
+            static T barycentric(const std::array<T, 4>& v, F x, F y) {
+                return TNM067::Interpolation::FixedPoint::barycentric(v, x, y);
+            }
+        };
+
+        /**
+         * Two pass resampling, first every input row is resampled to the output width, then every
+         * output row is computed as a weighted sum of whole rows from the first pass. The output
+         * is processed in tiles, each tile only resamples the input rows it needs. The result does
+         * not depend on the tile size or on running in parallel.
+         */
+        template <Method M, typename Arithmetic, typename T>
+        void upsampleSeparable(const LayerRAMPrecision<T>& inputImage,
+                               LayerRAMPrecision<T>& outputImage, size2_t tileSize, bool parallel) {
+            using A = typename Arithmetic::Value;
+            constexpr size_t taps = numTaps<M>();
+
+            const size2_t inputSize = inputImage.getDimensions();
+            const size2_t outputSize = outputImage.getDimensions();
+
+            const T* inPixels = inputImage.getDataTyped();
+            T* outPixels = outputImage.getDataTyped();
+
+            const auto columns = Arithmetic::template table<M>(inputSize, outputSize, 0);
+            const auto rows = Arithmetic::template table<M>(inputSize, outputSize, 1);
+
+            TNM067::forEachTile(outputSize, tileSize, parallel, [&](size2_t begin, size2_t end) {
+                const size_t width = end.x - begin.x;
+
+                // Range of input rows used by the output rows of this tile
+                const size_t firstRow = rows.indices[begin.y].front();
+                const size_t lastRow = rows.indices[end.y - 1].back();
+
+                // Horizontal pass, the needed input rows resampled to the columns of the tile
+                std::vector<A> horizontal(width * (lastRow - firstRow + 1));
+                for (size_t y = firstRow; y <= lastRow; ++y) {
+                    const T* src = inPixels + y * inputSize.x;
+                    A* dst = horizontal.data() + (y - firstRow) * width;
+                    for (size_t x = begin.x; x < end.x; ++x) {
+                        const auto& indices = columns.indices[x];
+                        const auto& weights = columns.weights[x];
+                        A sum(0);
+                        for (size_t k = 0; k < taps; ++k) {
+                            sum += Arithmetic::load(src[indices[k]]) * weights[k];
+                        }
+                        dst[x - begin.x] = Arithmetic::horizontal(sum);
+                    }
+                }
+
+                // Vertical pass
+                std::vector<A> row(width);
+                for (size_t y = begin.y; y < end.y; ++y) {
+                    std::fill(row.begin(), row.end(), A(0));
+                    for (size_t k = 0; k < taps; ++k) {
+                        const auto weight = rows.weights[y][k];
+                        const A* src = horizontal.data() + (rows.indices[y][k] - firstRow) * width;
+                        for (size_t x = 0; x < width; ++x) {
+                            row[x] += src[x] * weight;
+                        }
+                    }
+                    T* dst = outPixels + y * outputSize.x + begin.x;
+                    for (size_t x = 0; x < width; ++x) {
+                        dst[x] = Arithmetic::store(row[x]);
+                    }
+                }
+            });
+        }
+
+        template <typename Arithmetic, typename T>
+        void upsampleBarycentric(const LayerRAMPrecision<T>& inputImage,
+                                 LayerRAMPrecision<T>& outputImage, size2_t tileSize, bool parallel) {
+
+            const size2_t inputSize = inputImage.getDimensions();
+            const size2_t outputSize = outputImage.getDimensions();
+
+            const T* inPixels = inputImage.getDataTyped();
+            T* outPixels = outputImage.getDataTyped();
+
+            auto inIndex = [&inputSize] (auto pos) -> size_t {
+                pos = glm::clamp(pos, decltype(pos)(0), decltype(pos)(inputSize - size2_t(1)));
+                return pos.x + pos.y * inputSize.x;
+            };
+
+            auto upsamplePixel = [&] (ivec2 outImageCoords) {
+                // outImageCoords: Exact pixel coordinates in the output image currently writing to
+                // inImageCoords: Relative coordinates of outImageCoords in the input image, might be
+                // between pixels
+                const dvec2 inImageCoords =
+                    ImageUpsampler::convertCoordinate(outImageCoords, inputSize, outputSize);
+
+                // Get neighbouring pixels
+                const ivec2 pos0{ floor(inImageCoords) };
+                const ivec2 pos1{ ceil(inImageCoords.x), floor(inImageCoords.y) };
+                const ivec2 pos2{ floor(inImageCoords.x), ceil(inImageCoords.y) };
+                const ivec2 pos3{ ceil(inImageCoords) };
+
+                const std::array<T, 4> v{
+                    inPixels[inIndex(pos0)],
+                    inPixels[inIndex(pos1)],
+                    inPixels[inIndex(pos2)],
+                    inPixels[inIndex(pos3)],
+                };
+
+                // Get parameterization in x- and y-direction
+                const double x_t = inImageCoords.x - pos0.x;
+                const double y_t = inImageCoords.y - pos0.y;
+
+                outPixels[outImageCoords.x + outImageCoords.y * outputSize.x] =
+                    Arithmetic::barycentric(v, x_t, y_t);
+            };
+
+            TNM067::forEachTile(outputSize, tileSize, parallel, [&] (size2_t begin, size2_t end) {
+                for (size_t y = begin.y; y < end.y; ++y) {
+                    for (size_t x = begin.x; x < end.x; ++x) {
+                        upsamplePixel(ivec2(x, y));
+                    }
+                }
+            });
+        }
+
+        template <Method M, typename Arithmetic, typename T>
+        void upsampleWith(const LayerRAMPrecision<T>& inputImage, LayerRAMPrecision<T>& outputImage,
+                          size2_t tileSize, bool parallel) {
+            if constexpr (M == Method::Barycentric) {
+                upsampleBarycentric<Arithmetic>(inputImage, outputImage, tileSize, parallel);
+            } else {
+                upsampleSeparable<M, Arithmetic>(inputImage, outputImage, tileSize, parallel);
+            }
+        }
+
+        /**
+         * Upsampling with the interpolation method fixed at compile time, so that every method
+         * gets its own loop without any per pixel branching on the method. Unsigned 8 and 16-bit
+         * images use integer arithmetic if fixedPoint is set.
+         */
+        template <Method M, typename T>
+        void upsample(const LayerRAMPrecision<T>& inputImage, LayerRAMPrecision<T>& outputImage,
+                      size2_t tileSize, bool parallel, bool fixedPoint) {
+            if constexpr (TNM067::Interpolation::FixedPoint::traits<T>::supported) {
+                if (fixedPoint) {
+                    upsampleWith<M, FixedPointArithmetic<T>>(inputImage, outputImage, tileSize,
+                                                             parallel);
+                    return;
+                }
+            }
+            upsampleWith<M, FloatingPointArithmetic<T>>(inputImage, outputImage, tileSize,
+                                                        parallel);
+        }
+
+    }  // namespace detail
+
+}  // namespace inviwo
@@ -0,0 +1,88 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <benchmark/benchmark.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab1/utils/scalartocolormapping.h>
+
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace inviwo {
+
+    namespace {
+
+        // The kernel sampleBatch was compiled with, see tests/benchmarks/CMakeLists.txt
+#if defined(__AVX2__)
+        constexpr const char* kernel = "AVX2";
+#elif defined(__SSE4_1__)
+        constexpr const char* kernel = "SSE4.1";
+#else
+        constexpr const char* kernel = "scalar";
+#endif
+
+        ScalarToColorMapping makeMap() {
+            ScalarToColorMapping map;
+            map.addBaseColors(vec4(0.0f, 0.0f, 0.5f, 1.0f));
+            map.addBaseColors(vec4(0.0f, 0.5f, 1.0f, 1.0f));
+            map.addBaseColors(vec4(0.5f, 1.0f, 0.5f, 1.0f));
+            map.addBaseColors(vec4(1.0f, 0.5f, 0.0f, 1.0f));
+            map.addBaseColors(vec4(0.5f, 0.0f, 0.0f, 1.0f));
+            return map;
+        }
+
+        // Slightly outside of [0, 1] as well, to include the clamping
+        std::vector<float> makeValues(size_t size) {
+            std::mt19937 rng(0);
+            std::uniform_real_distribution<float> value(-0.05f, 1.05f);
+            std::vector<float> values(size);
+            for (auto& v : values) v = value(rng);
+            return values;
+        }
+
+        template <typename Color>
+        void perPixel(benchmark::State& state) {
+            const auto map = makeMap();
+            const auto in = makeValues(static_cast<size_t>(state.range(0)));
+            std::vector<Color> out(in.size());
+            for (auto _ : state) {
+                for (size_t i = 0; i < in.size(); ++i) {
+                    if constexpr (std::is_same_v<Color, vec4>) {
+                        out[i] = map.sample(in[i]);
+                    } else {
+                        out[i] = Color(map.sample(in[i]) * 255.f);
+                    }
+                }
+                benchmark::DoNotOptimize(out.data());
+                benchmark::ClobberMemory();
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            state.SetLabel(kernel);
+        }
+
+        template <typename Color>
+        void batch(benchmark::State& state) {
+            const auto map = makeMap();
+            const auto in = makeValues(static_cast<size_t>(state.range(0)));
+            std::vector<Color> out(in.size());
+            for (auto _ : state) {
+                map.sample(util::span<const float>(in), util::span<Color>(out));
+                benchmark::DoNotOptimize(out.data());
+                benchmark::ClobberMemory();
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            state.SetLabel(kernel);
+        }
+
+    }  // namespace
+
+    // A row of a 1024 wide image and a whole 1024^2 image
+    BENCHMARK_TEMPLATE(perPixel, glm::u8vec4)->Arg(1 << 10)->Arg(1 << 20);
+    BENCHMARK_TEMPLATE(batch, glm::u8vec4)->Arg(1 << 10)->Arg(1 << 20);
+    BENCHMARK_TEMPLATE(perPixel, vec4)->Arg(1 << 10)->Arg(1 << 20);
+    BENCHMARK_TEMPLATE(batch, vec4)->Arg(1 << 10)->Arg(1 << 20);
+
+}  // namespace inviwo
+
+BENCHMARK_MAIN();
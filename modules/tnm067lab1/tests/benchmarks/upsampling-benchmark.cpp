@@ -0,0 +1,83 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <benchmark/benchmark.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab1/processors/imageupsamplerdetail.h>
+#include <inviwo/core/datastructures/image/layerramprecision.h>
+#include <inviwo/core/util/glmutils.h>
+
+#include <limits>
+#include <random>
+#include <type_traits>
+
+namespace inviwo {
+
+    namespace {
+
+        using Method = ImageUpsampler::IntepolationMethod;
+
+        template <typename T>
+        void fillRandom(LayerRAMPrecision<T>& layer) {
+            using V = typename util::value_type<T>::type;
+            constexpr size_t extent = util::extent<T>::value;
+            std::mt19937 rng(0);
+            std::uniform_real_distribution<double> value(0.0, 1.0);
+            const double max = std::is_floating_point_v<V>
+                                   ? 1.0
+                                   : static_cast<double>(std::numeric_limits<V>::max());
+
+            T* data = layer.getDataTyped();
+            const size2_t dims = layer.getDimensions();
+            for (size_t i = 0; i < dims.x * dims.y; ++i) {
+                for (size_t c = 0; c < extent; ++c) {
+                    util::glmcomp(data[i], c) = static_cast<V>(value(rng) * max);
+                }
+            }
+        }
+
+        /**
+         * detail::upsample from 256^2 to 1024^2 pixels on the calling thread, with floating
+         * point arithmetic for range(0) = 0 and fixed point for range(0) = 1.
+         */
+        template <Method M, typename T>
+        void upsample(benchmark::State& state) {
+            const size2_t inputSize{256};
+            const size2_t outputSize{1024};
+            const size2_t tileSize{128};
+            const bool fixedPoint = state.range(0) != 0;
+
+            LayerRAMPrecision<T> input(inputSize);
+            LayerRAMPrecision<T> output(outputSize);
+            fillRandom(input);
+
+            for (auto _ : state) {
+                detail::upsample<M>(input, output, tileSize, false, fixedPoint);
+                benchmark::DoNotOptimize(output.getDataTyped());
+                benchmark::ClobberMemory();
+            }
+            state.SetItemsProcessed(state.iterations() * outputSize.x * outputSize.y);
+            state.SetBytesProcessed(state.iterations() * outputSize.x * outputSize.y * sizeof(T));
+        }
+
+    }  // namespace
+
+// Float arithmetic for all formats, fixed point as well for unsigned 8 and 16-bit formats
+#define UPSAMPLING_BENCHMARKS(method)                                                \
+    BENCHMARK_TEMPLATE(upsample, method, glm::u8)->Arg(0)->Arg(1);                   \
+    BENCHMARK_TEMPLATE(upsample, method, glm::u16)->Arg(0)->Arg(1);                  \
+    BENCHMARK_TEMPLATE(upsample, method, float)->Arg(0);                             \
+    BENCHMARK_TEMPLATE(upsample, method, glm::u8vec4)->Arg(0)->Arg(1);               \
+    BENCHMARK_TEMPLATE(upsample, method, glm::u16vec4)->Arg(0)->Arg(1);              \
+    BENCHMARK_TEMPLATE(upsample, method, vec4)->Arg(0);
+
+    UPSAMPLING_BENCHMARKS(Method::PiecewiseConstant)
+    UPSAMPLING_BENCHMARKS(Method::Bilinear)
+    UPSAMPLING_BENCHMARKS(Method::Biquadratic)
+    UPSAMPLING_BENCHMARKS(Method::Barycentric)
+
+#undef UPSAMPLING_BENCHMARKS
+
+}  // namespace inviwo
+
+BENCHMARK_MAIN();
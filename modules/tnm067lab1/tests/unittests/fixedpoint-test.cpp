@@ -0,0 +1,172 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab1/utils/interpolationmethods.h>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace inviwo {
+
+#if ENABLE_FIXEDPOINT_UNITTEST
+
+    namespace {
+
+        using namespace TNM067::Interpolation;
+
+        std::array<double, 2> linearWeights(double x) { return {1.0 - x, x}; }
+
+        // Weights of quadratic() at x
+        std::array<double, 3> quadraticWeights(double x) {
+            return {(1 - x) * (1 - 2 * x), 4 * x * (1 - x), x * (2 * x - 1)};
+        }
+
+        template <typename T>
+        double reference(double value) {
+            return glm::clamp(std::floor(value + 0.5), 0.0,
+                              static_cast<double>(std::numeric_limits<T>::max()));
+        }
+
+        // The weights after quantizing them for T
+        template <typename T, size_t N>
+        std::array<double, N> quantized(const std::array<double, N>& weights) {
+            const auto q = FixedPoint::quantizeWeights<T>(weights);
+            std::array<double, N> result;
+            for (size_t k = 0; k < N; ++k) result[k] = double(q[k]) / FixedPoint::one<T>;
+            return result;
+        }
+
+        // Largest magnitude the integers of the fixed point arithmetic of T can hold
+        template <typename T>
+        long double integerMax() {
+            return static_cast<long double>(std::numeric_limits<FixedPoint::Weight<T>>::max());
+        }
+
+        template <size_t N>
+        double separableReference(const std::array<double, N * N>& v,
+                                  const std::array<double, N>& x,
+                                  const std::array<double, N>& y) {
+            double sum = 0.0;
+            for (size_t j = 0; j < N; ++j) {
+                for (size_t i = 0; i < N; ++i) sum += v[N * j + i] * x[i] * y[j];
+            }
+            return sum;
+        }
+
+        /**
+         * Separable fixed point interpolation of an N x N neighbourhood, the same arithmetic as
+         * the fixed point path of ImageUpsampler. Also tracks the largest magnitude of a partial
+         * sum in the vertical pass, computed in extended precision.
+         */
+        template <typename T, size_t N>
+        T separable(const std::array<T, N * N>& v, const std::array<double, N>& x,
+                    const std::array<double, N>& y, long double& largestSum) {
+            using A = FixedPoint::accumulator<T>;
+            const auto wx = FixedPoint::quantizeWeights<T>(x);
+            const auto wy = FixedPoint::quantizeWeights<T>(y);
+
+            std::array<A, N> rows;
+            for (size_t j = 0; j < N; ++j) {
+                A sum(0);
+                for (size_t i = 0; i < N; ++i) sum += A(v[N * j + i]) * wx[i];
+                rows[j] = FixedPoint::horizontal<T>(sum);
+            }
+            A sum(0);
+            long double wideSum = 0;
+            for (size_t j = 0; j < N; ++j) {
+                sum += rows[j] * wy[j];
+                wideSum += static_cast<long double>(rows[j]) * wy[j];
+                largestSum = std::max(largestSum, std::abs(wideSum));
+            }
+            return FixedPoint::vertical<T>(sum);
+        }
+
+        /**
+         * Compares the fixed point result against the double reference with the same quantized
+         * weights, which only leaves the rounding of the integer arithmetic, and against the
+         * exact double reference, which also includes the quantization of the weights. Both
+         * 8 and 16-bit values are within one of either.
+         */
+        template <typename T, size_t N, typename Weights>
+        void testSeparable(Weights weights, int samples) {
+            std::mt19937 rng(0);
+            std::uniform_int_distribution<int> value(0, std::numeric_limits<T>::max());
+            std::uniform_real_distribution<double> pos(0.0, 1.0);
+            long double largestSum = 0;
+            for (int n = 0; n < samples; ++n) {
+                std::array<T, N * N> v;
+                std::array<double, N * N> d;
+                for (size_t i = 0; i < N * N; ++i) d[i] = v[i] = static_cast<T>(value(rng));
+                const auto x = weights(pos(rng));
+                const auto y = weights(pos(rng));
+                const double result = separable<T, N>(v, x, y, largestSum);
+
+                const auto qx = quantized<T>(x);
+                const auto qy = quantized<T>(y);
+                EXPECT_NEAR(reference<T>(separableReference<N>(d, qx, qy)), result, 1.0);
+                EXPECT_NEAR(reference<T>(separableReference<N>(d, x, y)), result, 1.0);
+            }
+            EXPECT_LE(largestSum, integerMax<T>());
+        }
+
+        /**
+         * The largest sums: maximal values where the weights are positive and zero where they
+         * are negative, at the positions with the largest overshoot of the quadratic weights.
+         */
+        template <typename T>
+        void testBiQuadraticOverflow() {
+            constexpr T max = std::numeric_limits<T>::max();
+            long double largestSum = 0;
+            for (int i = 0; i <= 64; ++i) {
+                const auto w = quadraticWeights(i / 64.0);
+                std::array<T, 9> v;
+                std::array<double, 9> d;
+                for (size_t k = 0; k < 9; ++k) {
+                    d[k] = v[k] = w[k % 3] * w[k / 3] > 0.0 ? max : T(0);
+                }
+                const double result = separable<T, 3>(v, w, w, largestSum);
+                EXPECT_NEAR(reference<T>(separableReference<3>(d, w, w)), result, 1.0);
+            }
+            EXPECT_LE(largestSum, integerMax<T>());
+        }
+
+        template <typename T>
+        void testBarycentric() {
+            std::mt19937 rng(0);
+            std::uniform_int_distribution<int> value(0, std::numeric_limits<T>::max());
+            std::uniform_real_distribution<double> pos(0.0, 1.0);
+            for (int n = 0; n < 100000; ++n) {
+                std::array<T, 4> v;
+                std::array<double, 4> d;
+                for (size_t i = 0; i < 4; ++i) d[i] = v[i] = static_cast<T>(value(rng));
+                const double x = pos(rng);
+                const double y = pos(rng);
+                EXPECT_NEAR(reference<T>(barycentric(d, x, y)), FixedPoint::barycentric(v, x, y),
+                            1.0);
+            }
+        }
+
+    }  // namespace
+
+    TEST(FixedPointInterpolation, Bilinear8) { testSeparable<glm::u8, 2>(linearWeights, 100000); }
+    TEST(FixedPointInterpolation, Bilinear16) {
+        testSeparable<glm::u16, 2>(linearWeights, 100000);
+    }
+    TEST(FixedPointInterpolation, BiQuadratic8) {
+        testSeparable<glm::u8, 3>(quadraticWeights, 100000);
+    }
+    TEST(FixedPointInterpolation, BiQuadratic16) {
+        testSeparable<glm::u16, 3>(quadraticWeights, 100000);
+    }
+    TEST(FixedPointInterpolation, BiQuadraticOverflow8) { testBiQuadraticOverflow<glm::u8>(); }
+    TEST(FixedPointInterpolation, BiQuadraticOverflow16) { testBiQuadraticOverflow<glm::u16>(); }
+    TEST(FixedPointInterpolation, Barycentric8) { testBarycentric<glm::u8>(); }
+    TEST(FixedPointInterpolation, Barycentric16) { testBarycentric<glm::u16>(); }
+
+#endif
+
+}  // namespace inviwo
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <modules/tnm067lab1/tnm067lab1moduledefine.h>
+#include <inviwo/core/common/inviwoapplication.h>
+#include <inviwo/core/util/logcentral.h>
+
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+namespace inviwo {
+
+    namespace TNM067 {
+
+        /**
+         * Runs the builds of a processor in the Inviwo thread pool, one at a time. Starting a job
+         * cancels the running one, which should poll its stop flag and return early. The new job
+         * waits until the cancelled one has returned, so jobs never overlap and can share caches.
+         * The result of a job that was not cancelled is handed to the processor on the main
+         * thread.
+         */
+        class BackgroundJob {
+        public:
+            using Stop = std::atomic<bool>;
+
+            BackgroundJob() = default;
+            BackgroundJob(const BackgroundJob&) = delete;
+            BackgroundJob& operator=(const BackgroundJob&) = delete;
+            ~BackgroundJob() {
+                cancel();
+                if (future_.valid()) future_.wait();
+            }
+
+            /**
+             * Cancels the running job and starts job(stop) once it has returned. done(result) is
+             * called on the main thread unless the job is cancelled before, also after job has
+             * returned. job must not refer to the processor, it may outlive it until it returns.
+             */
+            template <typename Job, typename Done>
+            void start(Job job, Done done) {
+                start([job](const Stop& stop, const auto&) { return job(stop); },
+                      [](const auto&) {}, done);
+            }
+
+            /**
+             * Like start(job, done), but job(stop, partial) can hand over intermediate results
+             * while it runs: partial(value) calls progress(value) on the main thread unless the
+             * job is cancelled before. Progress and done are called in the order they are handed
+             * over.
+             */
+            template <typename Job, typename Progress, typename Done>
+            void start(Job job, Progress progress, Done done) {
+                cancel();
+                auto stop = std::make_shared<Stop>(false);
+                stop_ = stop;
+                future_ = dispatchPool([stop, previous = future_, job, progress, done]() {
+                    if (previous.valid()) previous.wait();
+                    if (*stop) return;
+                    auto partial = [stop, progress](auto value) {
+                        if (*stop) return;
+                        dispatchFront([stop, progress, value = std::move(value)]() {
+                            if (!*stop) progress(value);
+                        });
+                    };
+                    try {
+                        using Result = std::decay_t<decltype(job(*stop, partial))>;
+                        auto result = std::make_shared<Result>(job(*stop, partial));
+                        if (*stop) return;
+                        dispatchFront([stop, result, done]() {
+                            if (!*stop) done(std::move(*result));
+                        });
+                    } catch (const std::exception& e) {
+                        LogErrorCustom("BackgroundJob", e.what());
+                    }
+                }).share();
+            }
+
+            // Cancels the running job, its result is dropped
+            void cancel() {
+                if (stop_) *stop_ = true;
+            }
+
+        private:
+            std::shared_ptr<Stop> stop_;
+            std::shared_future<void> future_;
+        };
+
+    }  // namespace TNM067
+
+}  // namespace inviwo
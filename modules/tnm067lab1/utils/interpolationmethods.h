@@ -2,7 +2,13 @@
 
 #include <modules/tnm067lab1/tnm067lab1moduledefine.h>
 #include <inviwo/core/util/glm.h>
+#include <inviwo/core/util/glmutils.h>
 
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 
 namespace inviwo {
 
@@ -42,7 +48,7 @@ namespace inviwo {
                 // b = x2
                 // x = t
 
-                T f = a * (1.0 - x) + b * x;
+                T f = a * (F(1) - x) + b * x;
                 return  f;
             }
 
@@ -120,9 +126,9 @@ namespace inviwo {
 #define ENABLE_BARYCENTRIC_UNITTEST 0
             template <typename T, typename F = double>
             T barycentric(const std::array<T, 4>& v, F x, F y) {
-                float alpha;
-                float beta;
-                float gamma;
+                F alpha;
+                F beta;
+                F gamma;
                 T f_a;
 
                 if (x + y < 1.0) {
@@ -142,6 +148,120 @@ namespace inviwo {
                 return f;
             }
 
+            /**
+             * Integer interpolation for unsigned 8 and 16-bit values (scalars or glm vectors).
+             * Weights are fixed point numbers with traits<T>::weightBits fractional bits, and
+             * results are rounded to the nearest value and clamped to the range of T. Separable
+             * kernels keep traits<T>::extraBits fractional bits between the horizontal and the
+             * vertical pass.
+             *
+             * 8-bit values use 12-bit weights in 32-bit integers, with quadratic weights the
+             * sums stay below 2^23. 16-bit values need 20-bit weights to be as accurate, which
+             * takes 64-bit integers. Both are within one of the rounded double result, see
+             * tests/unittests/fixedpoint-test.cpp.
+             */
+#define ENABLE_FIXEDPOINT_UNITTEST 1
+            namespace FixedPoint {
+                template <typename T>
+                struct traits {
+                    static constexpr bool supported = false;
+                };
+                template <>
+                struct traits<glm::u8> {
+                    static constexpr bool supported = true;
+                    using Integer = std::int32_t;
+                    static constexpr int weightBits = 12;
+                    static constexpr int extraBits = 4;
+                };
+                template <>
+                struct traits<glm::u16> {
+                    static constexpr bool supported = true;
+                    using Integer = std::int64_t;
+                    static constexpr int weightBits = 20;
+                    static constexpr int extraBits = 4;
+                };
+                template <glm::length_t L, glm::qualifier Q>
+                struct traits<glm::vec<L, glm::u8, Q>> : traits<glm::u8> {};
+                template <glm::length_t L, glm::qualifier Q>
+                struct traits<glm::vec<L, glm::u16, Q>> : traits<glm::u16> {};
+
+                template <typename T>
+                using Weight = typename traits<T>::Integer;
+
+                template <typename T>
+                using accumulator = typename util::same_extent<T, Weight<T>>::type;
+
+                template <typename T>
+                constexpr Weight<T> one = Weight<T>{1} << traits<T>::weightBits;
+
+                template <typename T, typename F>
+                Weight<T> toWeight(F w) {
+                    return static_cast<Weight<T>>(std::floor(w * F(one<T>) + F(0.5)));
+                }
+
+                // Quantized weights of one sample, the middle weight is adjusted so that the
+                // weights sum to exactly one
+                template <typename T, typename F, size_t N>
+                std::array<Weight<T>, N> quantizeWeights(const std::array<F, N>& weights) {
+                    std::array<Weight<T>, N> result;
+                    Weight<T> sum = 0;
+                    for (size_t k = 0; k < N; ++k) {
+                        if (k == N / 2) continue;
+                        result[k] = toWeight<T>(weights[k]);
+                        sum += result[k];
+                    }
+                    result[N / 2] = one<T> - sum;
+                    return result;
+                }
+
+                // Divides by 2^bits, rounding to nearest
+                template <typename A>
+                A roundShift(const A& value, int bits) {
+                    using I = typename util::value_type<A>::type;
+                    return (value + A(I{1} << (bits - 1))) >> I(bits);
+                }
+
+                template <typename T, typename A>
+                T toValue(const A& value) {
+                    constexpr auto max = std::numeric_limits<typename util::value_type<T>::type>::max();
+                    return static_cast<T>(glm::clamp(value, A(0), A(max)));
+                }
+
+                // Result of the horizontal pass from the weighted sum of values of T
+                template <typename T>
+                accumulator<T> horizontal(const accumulator<T>& sum) {
+                    return roundShift(sum, traits<T>::weightBits - traits<T>::extraBits);
+                }
+
+                // Result of the vertical pass from the weighted sum of horizontal results
+                template <typename T>
+                T vertical(const accumulator<T>& sum) {
+                    return toValue<T>(
+                        roundShift(sum, traits<T>::weightBits + traits<T>::extraBits));
+                }
+
+                // Same triangle selection as barycentric(), the weights sum to exactly one
+                template <typename T, typename F>
+                T barycentric(const std::array<T, 4>& v, F x, F y) {
+                    using A = accumulator<T>;
+                    Weight<T> beta;
+                    Weight<T> gamma;
+                    A f_a;
+                    if (x + y < 1.0) {
+                        beta = toWeight<T>(x);
+                        gamma = toWeight<T>(y);
+                        f_a = A(v[0]);
+                    } else {
+                        beta = toWeight<T>(F(1) - y);
+                        gamma = toWeight<T>(F(1) - x);
+                        f_a = A(v[3]);
+                    }
+                    const Weight<T> alpha = one<T> - beta - gamma;
+                    return toValue<T>(roundShift(f_a * alpha + A(v[1]) * beta + A(v[2]) * gamma,
+                                                 traits<T>::weightBits));
+                }
+            }  // namespace FixedPoint
+
         }  // namespace Interpolation
     }  // namespace TNM067
 }  // namespace inviwo
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <modules/tnm067lab1/tnm067lab1moduledefine.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace inviwo {
+
+    namespace TNM067 {
+
+        /**
+         * Keeps the outputs of a processor between calls to process() so that they can be reused
+         * instead of allocated every time. An output is handed out again once the pool holds the
+         * only reference to it, i.e. when the outport and all consumers have released it, and if
+         * it was created for the same key, typically the dimensions and the data format. The
+         * outport keeps the latest output, so a capacity of two lets a processor alternate
+         * between two outputs.
+         *
+         * The reused output keeps its contents and metadata, the caller has to overwrite
+         * everything it sets on a new output.
+         */
+        template <typename T, typename Key>
+        class OutputPool {
+        public:
+            explicit OutputPool(size_t capacity = 2) : capacity_{capacity} {}
+
+            /**
+             * Returns a free output created for key, or a new one from create() if there is none.
+             * Free outputs for other keys are dropped.
+             */
+            template <typename Create>
+            std::shared_ptr<T> get(const Key& key, Create&& create) {
+                for (const auto& item : items_) {
+                    if (item.data.use_count() == 1 && item.key == key) {
+                        ++reuses_;
+                        return item.data;
+                    }
+                }
+
+                auto isFree = [](const Item& item) { return item.data.use_count() == 1; };
+                items_.erase(std::remove_if(items_.begin(), items_.end(), isFree), items_.end());
+
+                ++allocations_;
+                std::shared_ptr<T> data = create();
+                if (items_.size() < capacity_) {
+                    items_.push_back({key, data});
+                }
+                return data;
+            }
+
+            void clear() { items_.clear(); }
+
+            // Number of outputs created and reused since construction
+            size_t allocations() const { return allocations_; }
+            size_t reuses() const { return reuses_; }
+
+            std::string statistics() const {
+                return std::to_string(allocations_) + " allocated, " + std::to_string(reuses_) +
+                       " reused";
+            }
+
+        private:
+            struct Item {
+                Key key;
+                std::shared_ptr<T> data;
+            };
+
+            size_t capacity_;
+            std::vector<Item> items_;
+            size_t allocations_ = 0;
+            size_t reuses_ = 0;
+        };
+
+    }  // namespace TNM067
+
+}  // namespace inviwo
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <modules/tnm067lab1/tnm067lab1moduledefine.h>
+#include <inviwo/core/common/inviwoapplication.h>
+#include <inviwo/core/util/glmvec.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace inviwo {
+
+    namespace TNM067 {
+
+        /**
+         * Calls func(i) for every i in [0, count). One worker per thread in the Inviwo thread pool
+         * takes the next job from a shared counter until all are done, so workers that finish
+         * early keep picking up the remaining jobs. The calling thread works as well. Runs
+         * serially if the pool is empty.
+         *
+         * The calling thread only waits for jobs that have been taken, not for workers to start,
+         * so parallelFor can be called from within the thread pool without deadlocking. The first
+         * exception thrown by func is rethrown once all taken jobs are done.
+         */
+        template <typename Func>
+        void parallelFor(size_t count, Func&& func) {
+            const size_t workers = std::min(count, InviwoApplication::getPtr()->getPoolSize() + 1);
+            if (workers <= 1) {
+                for (size_t i = 0; i < count; ++i) func(i);
+                return;
+            }
+
+            // Shared with the workers, which may start after parallelFor has returned
+            struct State {
+                std::atomic<size_t> next{0};
+                size_t remaining;
+                std::exception_ptr exception;
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+            auto state = std::make_shared<State>();
+            state->remaining = count;
+
+            // func is only called for taken jobs, while parallelFor is still waiting
+            auto worker = [state, count, &func]() {
+                size_t done = 0;
+                std::exception_ptr exception;
+                for (size_t i = state->next++; i < count; i = state->next++, ++done) {
+                    try {
+                        func(i);
+                    } catch (...) {
+                        if (!exception) exception = std::current_exception();
+                    }
+                }
+                if (done == 0) return;
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (exception && !state->exception) state->exception = exception;
+                state->remaining -= done;
+                if (state->remaining == 0) state->finished.notify_all();
+            };
+
+            for (size_t i = 1; i < workers; ++i) {
+                dispatchPool(worker);
+            }
+            worker();
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&]() { return state->remaining == 0; });
+            if (state->exception) std::rethrow_exception(state->exception);
+        }
+
+        /**
+         * Splits an image of size dims into tiles of at most tileSize pixels and calls
+         * func(begin, end) once per tile, where [begin, end) is the pixel range of the tile.
+         * Tiles are processed in parallel using parallelFor if requested.
+         */
+        template <typename Func>
+        void forEachTile(size2_t dims, size2_t tileSize, bool parallel, Func&& func) {
+            tileSize = glm::max(tileSize, size2_t(1));
+            const size2_t numTiles = (dims + tileSize - size2_t(1)) / tileSize;
+
+            auto tile = [&](size_t i) {
+                const size2_t begin = size2_t(i % numTiles.x, i / numTiles.x) * tileSize;
+                const size2_t end = glm::min(begin + tileSize, dims);
+                func(begin, end);
+            };
+
+            if (parallel) {
+                parallelFor(numTiles.x * numTiles.y, tile);
+            } else {
+                for (size_t i = 0; i < numTiles.x * numTiles.y; ++i) tile(i);
+            }
+        }
+
+    }  // namespace TNM067
+
+}  // namespace inviwo
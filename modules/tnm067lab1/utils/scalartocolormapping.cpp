@@ -1,10 +1,157 @@
 #include <modules/tnm067lab1/utils/scalartocolormapping.h>
 #include <inviwo/core/util/consolelogger.h>
+#include <inviwo/core/util/glmconvert.h>
+#include <inviwo/core/util/assertion.h>
+
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
 
 namespace inviwo {
 
-    void ScalarToColorMapping::clearColors() { baseColors_.clear(); }
-    void ScalarToColorMapping::addBaseColors(vec4 color) { baseColors_.push_back(color); }
+    namespace {
+        using Channels = std::array<std::vector<float>, 4>;
+
+#if defined(__AVX2__)
+        constexpr size_t simdWidth = 8;
+        using Lanes = __m256;
+
+        inline Lanes load(const float* in) { return _mm256_loadu_ps(in); }
+
+        // Same arithmetic as ScalarToColorMapping::sample, for 8 values at once. Requires at
+        // least two base colors.
+        inline void interpolate(const Channels& channels, Lanes t, Lanes rgba[4]) {
+            const int n = static_cast<int>(channels[0].size());
+            t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            const __m256 tNew = _mm256_mul_ps(t, _mm256_set1_ps(static_cast<float>(n - 1)));
+            const __m256i first =
+                _mm256_min_epi32(_mm256_cvttps_epi32(tNew), _mm256_set1_epi32(n - 2));
+            const __m256i second = _mm256_add_epi32(first, _mm256_set1_epi32(1));
+            const __m256 x = _mm256_sub_ps(tNew, _mm256_cvtepi32_ps(first));
+            const __m256 oneMinusX = _mm256_sub_ps(_mm256_set1_ps(1.0f), x);
+            for (size_t c = 0; c < 4; ++c) {
+                const __m256 a = _mm256_i32gather_ps(channels[c].data(), first, 4);
+                const __m256 b = _mm256_i32gather_ps(channels[c].data(), second, 4);
+                rgba[c] = _mm256_add_ps(_mm256_mul_ps(oneMinusX, a), _mm256_mul_ps(x, b));
+            }
+        }
+
+        inline void store(const Lanes rgba[4], glm::u8vec4* out) {
+            const __m256 scale = _mm256_set1_ps(255.0f);
+            const __m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(rgba[0], scale));
+            const __m256i g = _mm256_cvttps_epi32(_mm256_mul_ps(rgba[1], scale));
+            const __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(rgba[2], scale));
+            const __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(rgba[3], scale));
+            // Per 128-bit lane this gives r0-3 g0-3 b0-3 a0-3, shuffle into r0 g0 b0 a0 r1 ...
+            const __m256i bytes =
+                _mm256_packus_epi16(_mm256_packus_epi32(r, g), _mm256_packus_epi32(b, a));
+            const __m256i interleave =
+                _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, 0, 4, 8, 12,
+                                 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                                _mm256_shuffle_epi8(bytes, interleave));
+        }
+
+        inline void store(const Lanes rgba[4], vec4* out) {
+            alignas(32) float c[4][simdWidth];
+            for (size_t i = 0; i < 4; ++i) _mm256_store_ps(c[i], rgba[i]);
+            for (size_t i = 0; i < simdWidth; ++i) out[i] = vec4(c[0][i], c[1][i], c[2][i], c[3][i]);
+        }
+#elif defined(__SSE4_1__)
+        constexpr size_t simdWidth = 4;
+        using Lanes = __m128;
+
+        inline Lanes load(const float* in) { return _mm_loadu_ps(in); }
+
+        // Same arithmetic as ScalarToColorMapping::sample, for 4 values at once. Requires at
+        // least two base colors.
+        inline void interpolate(const Channels& channels, Lanes t, Lanes rgba[4]) {
+            const int n = static_cast<int>(channels[0].size());
+            t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            const __m128 tNew = _mm_mul_ps(t, _mm_set1_ps(static_cast<float>(n - 1)));
+            const __m128i first = _mm_min_epi32(_mm_cvttps_epi32(tNew), _mm_set1_epi32(n - 2));
+            const __m128 x = _mm_sub_ps(tNew, _mm_cvtepi32_ps(first));
+            const __m128 oneMinusX = _mm_sub_ps(_mm_set1_ps(1.0f), x);
+
+            alignas(16) int idx[simdWidth];
+            _mm_store_si128(reinterpret_cast<__m128i*>(idx), first);
+            for (size_t c = 0; c < 4; ++c) {
+                const float* ch = channels[c].data();
+                const __m128 a = _mm_setr_ps(ch[idx[0]], ch[idx[1]], ch[idx[2]], ch[idx[3]]);
+                const __m128 b =
+                    _mm_setr_ps(ch[idx[0] + 1], ch[idx[1] + 1], ch[idx[2] + 1], ch[idx[3] + 1]);
+                rgba[c] = _mm_add_ps(_mm_mul_ps(oneMinusX, a), _mm_mul_ps(x, b));
+            }
+        }
+
+        inline void store(const Lanes rgba[4], glm::u8vec4* out) {
+            const __m128 scale = _mm_set1_ps(255.0f);
+            const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(rgba[0], scale));
+            const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(rgba[1], scale));
+            const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(rgba[2], scale));
+            const __m128i a = _mm_cvttps_epi32(_mm_mul_ps(rgba[3], scale));
+            // Gives r0-3 g0-3 b0-3 a0-3, shuffle into r0 g0 b0 a0 r1 ...
+            const __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(r, g), _mm_packus_epi32(b, a));
+            const __m128i interleave =
+                _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(bytes, interleave));
+        }
+
+        inline void store(const Lanes rgba[4], vec4* out) {
+            __m128 r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            _mm_storeu_ps(&out[0].x, r);
+            _mm_storeu_ps(&out[1].x, g);
+            _mm_storeu_ps(&out[2].x, b);
+            _mm_storeu_ps(&out[3].x, a);
+        }
+#else
+        constexpr size_t simdWidth = 1;
+#endif
+
+        glm::u8vec4 toBytes(const vec4& color) { return glm::u8vec4(color * 255.f); }
+
+        template <typename Color>
+        void sampleBatch(const ScalarToColorMapping& map, const Channels& channels,
+                         util::span<const float> in, util::span<Color> out) {
+            IVW_ASSERT(out.size() >= in.size(), "Output has to be at least as large as the input");
+
+            size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE4_1__)
+            if (channels[0].size() >= 2) {
+                for (; i + simdWidth <= in.size(); i += simdWidth) {
+                    Lanes rgba[4];
+                    interpolate(channels, load(in.data() + i), rgba);
+                    store(rgba, out.data() + i);
+                }
+            }
+#endif
+            for (; i < in.size(); ++i) {
+                if constexpr (std::is_same_v<Color, vec4>) {
+                    out[i] = map.sample(in[i]);
+                } else {
+                    out[i] = toBytes(map.sample(in[i]));
+                }
+            }
+        }
+
+    }  // namespace
+
+    void ScalarToColorMapping::clearColors() {
+        baseColors_.clear();
+        for (auto& channel : channels_) channel.clear();
+        table_.clear();
+    }
+    void ScalarToColorMapping::addBaseColors(vec4 color) {
+        baseColors_.push_back(color);
+        for (size_t c = 0; c < 4; ++c) channels_[c].push_back(color[static_cast<int>(c)]);
+        table_.clear();
+    }
 
     vec4 ScalarToColorMapping::sample(float t) const {
         if (baseColors_.size() == 0) return vec4(t);
@@ -36,4 +183,39 @@ namespace inviwo {
         return vec4((1 - t_new) * firstColor + t_new * secondColor);
     }
 
+    void ScalarToColorMapping::bake(size_t resolution) {
+        resolution = std::max<size_t>(resolution, 2);
+        table_.resize(resolution);
+        for (size_t i = 0; i < resolution; ++i) {
+            const float t = static_cast<float>(i) / static_cast<float>(resolution - 1);
+            table_[i] = toBytes(sample(t));
+        }
+
+        // Use the same conversion as the per pixel path so that 8-bit lookups are exact
+        for (size_t i = 0; i < byteTable_.size(); ++i) {
+            const float t = util::glm_convert_normalized<float>(static_cast<glm::u8>(i));
+            byteTable_[i] = toBytes(sample(t));
+        }
+    }
+
+    void ScalarToColorMapping::sample(util::span<const float> in,
+                                      util::span<glm::u8vec4> out) const {
+        sampleBatch(*this, channels_, in, out);
+    }
+
+    void ScalarToColorMapping::sample(util::span<const float> in, util::span<vec4> out) const {
+        sampleBatch(*this, channels_, in, out);
+    }
+
+    bool ScalarToColorMapping::isBaked() const { return !table_.empty(); }
+
+    glm::u8vec4 ScalarToColorMapping::lookup(float t) const {
+        const float x = glm::clamp(t, 0.0f, 1.0f) * static_cast<float>(table_.size() - 1);
+        return table_[static_cast<size_t>(x + 0.5f)];
+    }
+
+    const std::array<glm::u8vec4, 256>& ScalarToColorMapping::getByteTable() const {
+        return byteTable_;
+    }
+
 }  // namespace inviwo
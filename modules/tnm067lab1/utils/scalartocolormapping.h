@@ -2,8 +2,10 @@
 
 #include <modules/tnm067lab1/tnm067lab1moduledefine.h>
 
+#include <array>
 #include <vector>
 #include <inviwo/core/util/glmvec.h>
+#include <inviwo/core/util/span.h>
 
 // Change this to one to enable the Unit tests for ScalarToColorMapping
 #define ENABLE_COLORMAPPING_UNITTEST 0
@@ -22,8 +24,39 @@ namespace inviwo {
         void clearColors();
         vec4 sample(float t) const;
 
+        /**
+         * Maps a batch of scalars, equivalent to calling sample(t) for each value (scaled by 255
+         * for the 8-bit overload). `out` has to be at least as large as `in`. Uses an AVX2 or
+         * SSE4.1 kernel when the module is compiled with those instruction sets enabled.
+         */
+        void sample(util::span<const float> in, util::span<glm::u8vec4> out) const;
+        void sample(util::span<const float> in, util::span<vec4> out) const;
+
+        /**
+         * Compiles the mapping into a lookup table with `resolution` entries sampled uniformly
+         * over [0,1], and a 256 entry table for raw 8-bit values. The tables are discarded
+         * whenever the base colors change and have to be baked again.
+         */
+        void bake(size_t resolution = 1024);
+        bool isBaked() const;
+
+        /**
+         * Nearest entry in the baked table, equivalent to sample(t) * 255 up to the table
+         * resolution. bake() has to be called first.
+         */
+        glm::u8vec4 lookup(float t) const;
+
+        /**
+         * Table indexed directly by a raw unsigned 8-bit value, entry i is the color of the
+         * normalized value of i. bake() has to be called first.
+         */
+        const std::array<glm::u8vec4, 256>& getByteTable() const;
+
     private:
         std::vector<vec4> baseColors_;  // base colors to be interpolated
+        std::array<std::vector<float>, 4> channels_;  // base colors as structure of arrays
+        std::vector<glm::u8vec4> table_;  // baked colors, empty if not baked
+        std::array<glm::u8vec4, 256> byteTable_;
     };
 
 }  // namespace inviwo
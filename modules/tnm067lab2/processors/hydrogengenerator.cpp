@@ -19,13 +19,22 @@ const ProcessorInfo HydrogenGenerator::processorInfo_{
 const ProcessorInfo HydrogenGenerator::getProcessorInfo() const { return processorInfo_; }
 
 HydrogenGenerator::HydrogenGenerator()
-    : Processor(), volume_("volume"), size_("size_", "Volume Size", 16, 4, 256) {
+    : Processor()
+    , volume_("volume")
+    , size_("size_", "Volume Size", 16, 4, 256)
+    , outputPoolStatistics_("outputPoolStatistics", "Output Volumes", "",
+                            InvalidationLevel::Valid) {
     addPort(volume_);
     addProperty(size_);
+    outputPoolStatistics_.setReadOnly(true);
+    outputPoolStatistics_.setSerializationMode(PropertySerializationMode::None);
+    addProperty(outputPoolStatistics_);
 }
 
 void HydrogenGenerator::process() {
-    auto vol = std::make_shared<Volume>(size3_t(size_), DataFloat32::get());
+    auto vol = outputPool_.get(size3_t(size_), [&]() {
+        return std::make_shared<Volume>(size3_t(size_), DataFloat32::get());
+    });
 
     auto ram = vol->getEditableRepresentation<VolumeRAM>();
     auto data = static_cast<float*>(ram->getData());
@@ -40,6 +49,7 @@ void HydrogenGenerator::process() {
     vol->dataMap_.dataRange = vol->dataMap_.valueRange = dvec2(minMax.first.x, minMax.second.x);
 
     volume_.setData(vol);
+    outputPoolStatistics_.set(outputPool_.statistics());
 }
 
 vec3 HydrogenGenerator::cartesianToSpherical(vec3 cartesian) {
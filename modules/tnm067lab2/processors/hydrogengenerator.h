@@ -3,8 +3,10 @@
 #include <modules/tnm067lab2/tnm067lab2moduledefine.h>
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
 #include <inviwo/core/ports/imageport.h>
 #include <inviwo/core/ports/volumeport.h>
+#include <modules/tnm067lab1/utils/outputpool.h>
 
 namespace inviwo {
 
@@ -27,6 +29,9 @@ private:
     VolumeOutport volume_;
 
     IntSizeTProperty size_;
+
+    TNM067::OutputPool<Volume, size3_t> outputPool_;  // Output volumes by dimensions
+    StringProperty outputPoolStatistics_;
 };
 
 }  // namespace inviwo
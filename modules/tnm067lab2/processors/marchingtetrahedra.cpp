@@ -1,43 +1,396 @@
 #include <modules/tnm067lab2/processors/marchingtetrahedra.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/datastructures/buffer/buffer.h>
+#include <inviwo/core/datastructures/volume/volume.h>
 #include <inviwo/core/datastructures/volume/volumeram.h>
 #include <inviwo/core/util/indexmapper.h>
+#include <inviwo/core/util/glmutils.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
 #include <inviwo/core/util/assertion.h>
 #include <inviwo/core/network/networklock.h>
 #include <modules/tnm067lab1/utils/interpolationmethods.h>
+#include <modules/tnm067lab1/utils/parallelfor.h>
 #include <inviwo/core/util/consolelogger.h>
+#include <inviwo/core/util/stdextensions.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <iostream>
+#include <string>
 
 namespace inviwo {
 
-    // ------------------ OUR OWN FUNCTIONS AND STRUCTS --------------------
+    namespace {
 
-    void MarchingTetrahedra::createTriangle(const TriEdge& edge0, const TriEdge& edge1, const TriEdge& edge2, float iso, const MarchingTetrahedra::Tetrahedra& tetra, MarchingTetrahedra::MeshHelper& mesh) {
+        // Edge between two DataPoints, from origin to dest
+        using Edge = std::array<std::uint8_t, 2>;
+        using Triangle = std::array<Edge, 3>;
 
-        // Interpolation lambda function
-        auto interPos = [iso, &tetra] (TriEdge s) -> vec3 {
-            return tetra.dataPoints[s.origin].pos + (tetra.dataPoints[s.dest].pos - tetra.dataPoints[s.origin].pos) * ((iso - tetra.dataPoints[s.origin].value) / (tetra.dataPoints[s.dest].value - tetra.dataPoints[s.origin].value));
+        // Triangles of the iso surface within a tetrahedron
+        struct Triangles {
+            size_t count;
+            std::array<Triangle, 2> triangles;
         };
-        // origin.pos + (dest.pos - origin.pos) * (iso - origin.val) / (dest.val - origin.val)
 
-    // Get interpolated vertices
-        auto interVert0 = interPos(edge0); // 0->1
-        auto interVert1 = interPos(edge1); // 0->2
-        auto interVert2 = interPos(edge2); // 0->3
+        /**
+         * Triangles for each of the 16 cases of a tetrahedron, where bit p of the case is set if
+         * DataPoint p of the tetrahedron is below the iso value. Edges refer to the DataPoints of
+         * the tetrahedron and the triangles are wound to face the same way in every case.
+         */
+        constexpr std::array<Triangles, 16> tetrahedronCases{{
+            {0, {}},
+            {1, {{{{{0, 1}, {0, 2}, {0, 3}}}}}},
+            {1, {{{{{1, 0}, {1, 3}, {1, 2}}}}}},
+            {2, {{{{{0, 3}, {1, 3}, {1, 2}}}, {{{0, 3}, {1, 2}, {0, 2}}}}}},
+            {1, {{{{{2, 0}, {2, 1}, {2, 3}}}}}},
+            {2, {{{{{0, 3}, {0, 1}, {1, 2}}}, {{{0, 3}, {1, 2}, {2, 3}}}}}},
+            {2, {{{{{0, 2}, {0, 1}, {1, 3}}}, {{{0, 2}, {1, 3}, {3, 2}}}}}},
+            {1, {{{{{1, 3}, {2, 3}, {0, 3}}}}}},
+            {1, {{{{{1, 3}, {0, 3}, {2, 3}}}}}},
+            {2, {{{{{0, 2}, {1, 3}, {0, 1}}}, {{{0, 2}, {3, 2}, {1, 3}}}}}},
+            {2, {{{{{0, 3}, {1, 2}, {0, 1}}}, {{{0, 3}, {2, 3}, {1, 2}}}}}},
+            {1, {{{{{2, 0}, {2, 3}, {2, 1}}}}}},
+            {2, {{{{{0, 3}, {1, 2}, {1, 3}}}, {{{0, 3}, {0, 2}, {1, 2}}}}}},
+            {1, {{{{{1, 0}, {1, 2}, {1, 3}}}}}},
+            {1, {{{{{0, 1}, {0, 3}, {0, 2}}}}}},
+            {0, {}},
+        }};
 
-        // Add interpolated vertices and get their indices
-        size_t i0{ mesh.addVertex(interVert0, tetra.dataPoints[edge0.origin].index, tetra.dataPoints[edge0.dest].index) };
-        size_t i1{ mesh.addVertex(interVert1, tetra.dataPoints[edge1.origin].index, tetra.dataPoints[edge1.dest].index) };
-        size_t i2{ mesh.addVertex(interVert2, tetra.dataPoints[edge2.origin].index, tetra.dataPoints[edge2.dest].index) };
+        // Subdivision of a cell into tetrahedra, by DataPoint index in the cell
+        constexpr std::uint8_t tetrahedraIds[6][4] = {{0, 1, 2, 5}, {1, 3, 2, 5}, {3, 2, 5, 7},
+                                                      {0, 2, 4, 5}, {6, 4, 2, 5}, {6, 7, 5, 2}};
 
-        // Add triangle to mesh
-        mesh.addTriangle(i0, i1, i2);
-    };
+        /**
+         * Subdivision into five tetrahedra, four corners and a central one, for cells with even and
+         * odd x + y + z. The face diagonals of the two alternate, so they match between
+         * neighbouring cells. All tetrahedra have the same orientation as tetrahedraIds.
+         */
+        constexpr std::uint8_t evenTetrahedraIds[5][4] = {
+            {0, 1, 2, 4}, {3, 2, 1, 7}, {5, 1, 4, 7}, {6, 4, 2, 7}, {1, 2, 4, 7}};
+        constexpr std::uint8_t oddTetrahedraIds[5][4] = {
+            {1, 3, 0, 5}, {2, 0, 3, 6}, {4, 5, 0, 6}, {7, 3, 5, 6}, {0, 5, 3, 6}};
+
+        // Tetrahedra of a cell and their triangles for every case
+        struct Decomposition {
+            size_t count;
+            std::array<std::array<std::uint8_t, 4>, 6> tetrahedra;
+            // tetrahedronCases for each tetrahedron, edges refer to DataPoints of the cell
+            std::array<std::array<Triangles, 16>, 6> cases;
+        };
+
+        template <size_t N>
+        constexpr Decomposition makeDecomposition(const std::uint8_t (&ids)[N][4]) {
+            Decomposition decomposition{};
+            decomposition.count = N;
+            for (size_t t = 0; t < N; ++t) {
+                for (size_t p = 0; p < 4; ++p) {
+                    decomposition.tetrahedra[t][p] = ids[t][p];
+                }
+                for (size_t c = 0; c < 16; ++c) {
+                    const auto& local = tetrahedronCases[c];
+                    auto& cell = decomposition.cases[t][c];
+                    cell.count = local.count;
+                    for (size_t n = 0; n < local.count; ++n) {
+                        for (size_t e = 0; e < 3; ++e) {
+                            cell.triangles[n][e][0] = ids[t][local.triangles[n][e][0]];
+                            cell.triangles[n][e][1] = ids[t][local.triangles[n][e][1]];
+                        }
+                    }
+                }
+            }
+            return decomposition;
+        }
+
+        constexpr Decomposition sixTetrahedra = makeDecomposition(tetrahedraIds);
+        constexpr std::array<Decomposition, 2> fiveTetrahedra{
+            makeDecomposition(evenTetrahedraIds), makeDecomposition(oddTetrahedraIds)};
+
+        /**
+         * Which of the 13 directions of EdgeSlices the edges of the cell decomposition have. The
+         * edge between the DataPoints a < b of a cell goes to the neighbour at
+         * (dx+1) + 3(dy+1) + 9(dz+1) - 14.
+         */
+        std::array<bool, 13> edgeDirections(MarchingTetrahedra::CellDecomposition decomposition) {
+            std::array<bool, 13> used{};
+            auto add = [&](std::uint8_t a, std::uint8_t b) {
+                if (b < a) std::swap(a, b);
+                const int dx = (b & 1) - (a & 1);
+                const int dy = ((b >> 1) & 1) - ((a >> 1) & 1);
+                const int dz = (b >> 2) - (a >> 2);
+                used[static_cast<size_t>((dx + 1) + 3 * (dy + 1) + 9 * (dz + 1) - 14)] = true;
+            };
+            auto addTetrahedra = [&](const Decomposition& tetrahedra) {
+                for (size_t t = 0; t < tetrahedra.count; ++t) {
+                    const auto& ids = tetrahedra.tetrahedra[t];
+                    for (size_t p = 0; p < 4; ++p) {
+                        for (size_t q = p + 1; q < 4; ++q) add(ids[p], ids[q]);
+                    }
+                }
+            };
+            switch (decomposition) {
+                case MarchingTetrahedra::CellDecomposition::Cubes:
+                    // The edges of the cell
+                    for (std::uint8_t a = 0; a < 8; ++a) {
+                        for (std::uint8_t bit = 1; bit < 8; bit <<= 1) {
+                            if (!(a & bit)) add(a, a | bit);
+                        }
+                    }
+                    break;
+                case MarchingTetrahedra::CellDecomposition::FiveTetrahedra:
+                    addTetrahedra(fiveTetrahedra[0]);
+                    addTetrahedra(fiveTetrahedra[1]);
+                    break;
+                case MarchingTetrahedra::CellDecomposition::SixTetrahedra:
+                default:
+                    addTetrahedra(sixTetrahedra);
+                    break;
+            }
+            return used;
+        }
+
+        // Case of a tetrahedron given the case of the cell, bit k set if DataPoint k is below iso
+        constexpr unsigned tetrahedronCase(unsigned cellCase,
+                                           const std::array<std::uint8_t, 4>& tetrahedron) {
+            return ((cellCase >> tetrahedron[0]) & 1u) |
+                   (((cellCase >> tetrahedron[1]) & 1u) << 1) |
+                   (((cellCase >> tetrahedron[2]) & 1u) << 2) |
+                   (((cellCase >> tetrahedron[3]) & 1u) << 3);
+        }
+
+        // Triangles of the iso surface within a cell
+        struct CubeTriangles {
+            size_t count;
+            std::array<Triangle, 12> triangles;
+        };
+
+        /**
+         * Marching cubes triangles for each of the 256 cases of a cell, where bit k of the case is
+         * set if DataPoint k is below the iso value. Edges refer to the DataPoints of the cell and
+         * always go from the lower to the higher index.
+         *
+         * Ambiguous faces are resolved by a rule that only looks at the face: the iso lines of a
+         * face cut off each run of adjacent corners below the iso value, so two diagonal corners
+         * below are always separated. Both cells sharing a face make the same choice, which keeps
+         * the surface free of cracks. The lines of all faces are chained into closed polygons that
+         * are triangulated as fans and wound like tetrahedronCases.
+         */
+        const std::array<CubeTriangles, 256>& cubeCases() {
+            static const auto table = []() {
+                // Faces of a cell, corners counterclockwise seen from outside
+                constexpr std::uint8_t faces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                                                      {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+                auto edge = [](std::uint8_t a, std::uint8_t b) {
+                    return a < b ? Edge{a, b} : Edge{b, a};
+                };
+
+                // Closed polygons of the iso surface, as the edges they cross
+                auto polygons = [&](unsigned cellCase) {
+                    // Iso lines of the faces, from the edge where a run of corners below the iso
+                    // value starts to the edge where it ends. The two faces of an edge pass it in
+                    // opposite directions, so the lines of neighbouring faces join up.
+                    std::vector<std::array<Edge, 2>> lines;
+                    for (const auto& face : faces) {
+                        auto below = [&](size_t i) { return (cellCase >> face[i % 4]) & 1u; };
+                        for (size_t first = 0; first < 4; ++first) {
+                            if (!below(first) || below(first + 3)) continue;
+                            size_t last = first;
+                            while (below(last + 1)) ++last;
+                            lines.push_back({edge(face[(first + 3) % 4], face[first]),
+                                             edge(face[last % 4], face[(last + 1) % 4])});
+                        }
+                    }
+
+                    std::vector<std::vector<Edge>> result;
+                    while (!lines.empty()) {
+                        std::vector<Edge> polygon{lines.back()[0]};
+                        Edge next = lines.back()[1];
+                        lines.pop_back();
+                        while (next != polygon.front()) {
+                            polygon.push_back(next);
+                            auto line = std::find_if(lines.begin(), lines.end(),
+                                                     [&](const auto& l) { return l[0] == next; });
+                            next = (*line)[1];
+                            lines.erase(line);
+                        }
+                        result.push_back(std::move(polygon));
+                    }
+                    return result;
+                };
+
+                // Wind the triangles like tetrahedronCases, facing away from the DataPoints below
+                // the iso value. Checked on the case where only DataPoint 0 is below.
+                auto midpoint = [](const Edge& e) {
+                    return 0.5f * (vec3(e[0] & 1, (e[0] >> 1) & 1, e[0] >> 2) +
+                                   vec3(e[1] & 1, (e[1] >> 1) & 1, e[1] >> 2));
+                };
+                const auto corner = polygons(1).front();
+                const vec3 normal = glm::cross(midpoint(corner[1]) - midpoint(corner[0]),
+                                               midpoint(corner[2]) - midpoint(corner[0]));
+                const bool flip = glm::dot(normal, vec3(1.0f)) < 0.0f;
+
+                // Whether two edges lie in the same face, i.e. a diagonal between them would lie
+                // in that face and could overlap the surface of the neighbouring cell
+                auto sameFace = [](const Edge& a, const Edge& b) {
+                    for (unsigned axis = 0; axis < 3; ++axis) {
+                        const unsigned bit = (a[0] >> axis) & 1u;
+                        if (((a[1] >> axis) & 1u) == bit && ((b[0] >> axis) & 1u) == bit &&
+                            ((b[1] >> axis) & 1u) == bit) {
+                            return true;
+                        }
+                    }
+                    return false;
+                };
+
+                std::array<CubeTriangles, 256> cases{};
+                for (unsigned c = 0; c < 256; ++c) {
+                    auto add = [&](const Edge& a, const Edge& b, const Edge& d) {
+                        cases[c].triangles[cases[c].count++] =
+                            flip ? Triangle{a, d, b} : Triangle{a, b, d};
+                    };
+                    // Clip ears whose diagonal passes through the inside of the cell
+                    for (auto polygon : polygons(c)) {
+                        while (polygon.size() > 3) {
+                            const size_t n = polygon.size();
+                            size_t i = 0;
+                            while (sameFace(polygon[(i + n - 1) % n], polygon[(i + 1) % n])) ++i;
+                            add(polygon[(i + n - 1) % n], polygon[i], polygon[(i + 1) % n]);
+                            polygon.erase(polygon.begin() + i);
+                        }
+                        add(polygon[0], polygon[1], polygon[2]);
+                    }
+                }
+                return cases;
+            }();
+            return table;
+        }
+
+        /**
+         * Octahedron encoding of a normal as two 16-bit snorms. The direction is projected onto
+         * the octahedron |x| + |y| + |z| = 1 and the lower half is folded over the upper one.
+         * Decode with n = (e.x, e.y, 1 - |e.x| - |e.y|); if n.z < 0, n.xy = (1 - |n.yx|) *
+         * sign(n.xy); then normalize n.
+         */
+        glm::i16vec2 encodeOctahedron(vec3 n) {
+            const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+            if (l1 == 0.0f) return glm::i16vec2(0);
+            n /= l1;
+            vec2 e(n.x, n.y);
+            if (n.z < 0.0f) {
+                const vec2 sign(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+                e = (vec2(1.0f) - glm::abs(vec2(n.y, n.x))) * sign;
+            }
+            return glm::i16vec2(glm::round(glm::clamp(e, -1.0f, 1.0f) * 32767.0f));
+        }
+
+        /**
+         * Converts the size.x x size.y DataPoints of plane begin.z of the volume from begin.x,
+         * begin.y on to float, row by row. Dispatches once on the format, the value is the first
+         * component as returned by VolumeRAM::getAsDouble.
+         */
+        void loadPlane(const VolumeRAM& volume, size3_t begin, size2_t size,
+                       std::vector<float>& values) {
+            const size3_t dims = volume.getDimensions();
+            volume.dispatch<void>([&](const auto vr) {
+                const auto data = vr->getDataTyped();
+                auto value = values.begin();
+                for (size_t y = begin.y; y < begin.y + size.y; ++y) {
+                    const auto row = data + (begin.z * dims.y + y) * dims.x + begin.x;
+                    for (size_t x = 0; x < size.x; ++x) {
+                        *value++ = static_cast<float>(util::glmcomp(row[x], 0));
+                    }
+                }
+            });
+        }
+
+        /**
+         * True if a DataPoint of the cells with begin <= pos < end has a value in [lo, hi), that
+         * is below the iso value hi but not below lo. Otherwise the cells have the same cases
+         * for both iso values.
+         */
+        bool anyValueBetween(const VolumeRAM& volume, size3_t begin, size3_t end, float lo,
+                             float hi) {
+            if (!(lo < hi)) return false;
+            const size3_t dims = volume.getDimensions();
+            bool found = false;
+            volume.dispatch<void>([&](const auto vr) {
+                const auto data = vr->getDataTyped();
+                for (size_t z = begin.z; z <= end.z && !found; ++z) {
+                    for (size_t y = begin.y; y <= end.y && !found; ++y) {
+                        const auto row = data + (z * dims.y + y) * dims.x;
+                        for (size_t x = begin.x; x <= end.x && !found; ++x) {
+                            const auto value = static_cast<float>(util::glmcomp(row[x], 0));
+                            found = value >= lo && value < hi;
+                        }
+                    }
+                }
+            });
+            return found;
+        }
+
+        // Hash of the edge between two DataPoints, by their indices
+        struct EdgeHash {
+            size_t operator()(const std::pair<size_t, size_t>& edge) const {
+                return std::hash<size_t>{}(edge.first * 31 + edge.second);
+            }
+        };
+
+        // Volumes with fewer cells are extracted at full resolution right away, a preview would
+        // hardly be faster than that
+        constexpr size_t minPreviewCells = 64 * 64 * 64;
+
+        /**
+         * About every stride-th DataPoint of the volume along each axis as a float volume with
+         * the same model and world matrices. The samples are spread evenly from the first to the
+         * last DataPoint, so the preview covers the same bounds as the volume.
+         */
+        std::pair<std::shared_ptr<Volume>, const VolumeRAM*> stridedVolume(
+            const Volume& volume, const VolumeRAM& volumeRAM, size_t stride) {
+            const size3_t dims = volumeRAM.getDimensions();
+            const size3_t steps = glm::max(dims, size3_t(2)) - size3_t(1);
+            const size3_t samples =
+                glm::min((steps + size3_t(stride - 1)) / stride + size3_t(1), dims);
+
+            std::array<std::vector<size_t>, 3> indices;
+            for (size_t axis = 0; axis < 3; ++axis) {
+                indices[axis].resize(samples[axis]);
+                for (size_t i = 0; i < samples[axis]; ++i) {
+                    indices[axis][i] =
+                        samples[axis] > 1 ? (i * (dims[axis] - 1) + (samples[axis] - 1) / 2) /
+                                                (samples[axis] - 1)
+                                          : 0;
+                }
+            }
 
-    // ----------------------------------------------------------------------
+            auto ram = std::make_shared<VolumeRAMPrecision<float>>(samples);
+            float* data = ram->getDataTyped();
+            std::vector<float> row(dims.x);
+            for (size_t z = 0; z < samples.z; ++z) {
+                for (size_t y = 0; y < samples.y; ++y) {
+                    loadPlane(volumeRAM, size3_t(0, indices[1][y], indices[2][z]),
+                              size2_t(dims.x, 1), row);
+                    for (size_t x = 0; x < samples.x; ++x) {
+                        *data++ = row[indices[0][x]];
+                    }
+                }
+            }
+
+            auto preview = std::make_shared<Volume>(ram);
+            preview->setModelMatrix(volume.getModelMatrix());
+            preview->setWorldMatrix(volume.getWorldMatrix());
+            return {preview, ram.get()};
+        }
 
-    size_t MarchingTetrahedra::HashFunc::max = 1;
+    }  // namespace
 
     const ProcessorInfo MarchingTetrahedra::processorInfo_{
         "org.inviwo.MarchingTetrahedra",  // Class identifier
@@ -52,193 +405,503 @@ namespace inviwo {
         : Processor()
         , volume_("volume")
         , mesh_("mesh")
-        , isoValue_("isoValue", "ISO value", 0.5f, 0.0f, 1.0f) {
+        , meshes_("meshes")
+        , isoValue_("isoValue", "ISO value", 0.5f, 0.0f, 1.0f)
+        , parallel_("parallel", "Parallel", true)
+        , decomposition_("decomposition", "Cell Decomposition",
+                         {{"six", "Six Tetrahedra", CellDecomposition::SixTetrahedra},
+                          {"five", "Five Tetrahedra (alternating)",
+                           CellDecomposition::FiveTetrahedra},
+                          {"cubes", "Marching Cubes", CellDecomposition::Cubes}},
+                         0)
+        , gradientNormals_("gradientNormals", "Normals from Gradient", false)
+        , compactOutput_("compactOutput", "Compact Output", false)
+        , previewStride_("previewStride", "Preview Stride", 4, 1, 16)
+        , multipleIsoValues_("multipleIsoValues", "Multiple ISO values", false)
+        , numIsoValues_("numIsoValues", "Number of ISO values", 2, 1, 20)
+        , isoValues_(util::make_array<20>([](auto i) {
+            return FloatProperty("isoValue" + std::to_string(i + 1),
+                                 "ISO value " + std::to_string(i + 1), 0.5f, 0.0f, 1.0f);
+        }))
+        , cache_(std::make_shared<Cache>()) {
 
         addPort(volume_);
         addPort(mesh_);
+        addPort(meshes_);
 
         addProperty(isoValue_);
+        addProperty(parallel_);
+        addProperty(decomposition_);
+        addProperty(gradientNormals_);
+        addProperty(compactOutput_);
+        addProperty(previewStride_);
+        addProperty(multipleIsoValues_);
+        addProperty(numIsoValues_);
+        for (auto& iso : isoValues_) {
+            addProperty(iso);
+        }
 
         isoValue_.setSerializationMode(PropertySerializationMode::All);
+        for (auto& iso : isoValues_) {
+            iso.setSerializationMode(PropertySerializationMode::All);
+        }
+
+        auto isoVisibility = [&]() {
+            isoValue_.setVisible(!multipleIsoValues_);
+            numIsoValues_.setVisible(multipleIsoValues_);
+            for (size_t i = 0; i < isoValues_.size(); i++) {
+                isoValues_[i].setVisible(multipleIsoValues_ && i < numIsoValues_);
+            }
+        };
+        multipleIsoValues_.onChange(isoVisibility);
+        numIsoValues_.onChange(isoVisibility);
+        isoVisibility();
 
         volume_.onChange([&] () {
+            cache_ = std::make_shared<Cache>();
             if (!volume_.hasData()) {
                 return;
             }
             NetworkLock lock(getNetwork());
-            float iso = (isoValue_.get() - isoValue_.getMinValue()) /
-                (isoValue_.getMaxValue() - isoValue_.getMinValue());
             const auto vr = volume_.getData()->dataMap_.valueRange;
-            isoValue_.setMinValue(static_cast<float>(vr.x));
-            isoValue_.setMaxValue(static_cast<float>(vr.y));
-            isoValue_.setIncrement(static_cast<float>(glm::abs(vr.y - vr.x) / 50.0));
-            isoValue_.set(static_cast<float>(iso * (vr.y - vr.x) + vr.x));
-            isoValue_.setCurrentStateAsDefault();
+            auto updateRange = [&](FloatProperty& isoValue) {
+                float iso = (isoValue.get() - isoValue.getMinValue()) /
+                    (isoValue.getMaxValue() - isoValue.getMinValue());
+                isoValue.setMinValue(static_cast<float>(vr.x));
+                isoValue.setMaxValue(static_cast<float>(vr.y));
+                isoValue.setIncrement(static_cast<float>(glm::abs(vr.y - vr.x) / 50.0));
+                isoValue.set(static_cast<float>(iso * (vr.y - vr.x) + vr.x));
+                isoValue.setCurrentStateAsDefault();
+            };
+            updateRange(isoValue_);
+            for (auto& iso : isoValues_) {
+                updateRange(iso);
+            }
                          });
     }
 
     void MarchingTetrahedra::process() {
-        auto volume = volume_.getData()->getRepresentation<VolumeRAM>();
-        MeshHelper mesh(volume_.getData());
+        const auto& properties = getProperties();
+        const bool changed =
+            volume_.isChanged() || std::any_of(properties.begin(), properties.end(),
+                                               [](Property* p) { return p->isModified(); });
 
-        const auto& dims = volume->getDimensions();
-        MarchingTetrahedra::HashFunc::max = dims.x * dims.y * dims.z;
+        // Keep the last finished meshes on the outports until the next extraction is done. A
+        // preview is followed by the full resolution extraction for the same settings.
+        bool refine = false;
+        if (finished_) {
+            auto& meshes = finished_->meshes;
+            if (finished_->multipleIsoValues) {
+                meshes_.setData(
+                    std::make_shared<std::vector<std::shared_ptr<Mesh>>>(std::move(meshes)));
+                mesh_.clear();
+            } else {
+                mesh_.setData(meshes.front());
+                meshes_.clear();
+            }
+            refine = finished_->preview && !changed;
+            finished_.reset();
+        }
+        if (!changed && !refine) return;
 
-        const float iso = isoValue_.get();
+        Settings settings;
+        if (multipleIsoValues_) {
+            for (size_t i = 0; i < numIsoValues_; ++i) {
+                settings.isoValues.push_back(isoValues_[i].get());
+            }
+        } else {
+            settings.isoValues.push_back(isoValue_.get());
+        }
+        settings.multipleIsoValues = multipleIsoValues_;
+        settings.parallel = parallel_;
+        settings.decomposition = decomposition_;
+        settings.gradientNormals = gradientNormals_;
+        settings.compactOutput = compactOutput_;
 
-        util::IndexMapper3D indexInVolume(dims);
+        // The representation is created here, on the main thread
+        auto volume = volume_.getData();
+        const VolumeRAM* volumeRAM = volume->getRepresentation<VolumeRAM>();
 
-        const static size_t tetrahedraIds[6][4] = { { 0, 1, 2, 5 }, { 1, 3, 2, 5 }, { 3, 2, 5, 7 },
-                                                   { 0, 2, 4, 5 }, { 6, 4, 2, 5 }, { 6, 7, 5, 2 } };
+        const size3_t numCells = glm::max(volumeRAM->getDimensions(), size3_t(1)) - size3_t(1);
+        const bool smallVolume = numCells.x * numCells.y * numCells.z < minPreviewCells;
+        const size_t stride = refine || smallVolume ? 1 : previewStride_.get();
+        job_.start(
+            [volume, volumeRAM, settings, stride,
+             cache = cache_](const TNM067::BackgroundJob::Stop& stop) {
+                if (!cache->bricks) {
+                    cache->bricks.emplace(*volumeRAM);
+                }
+                // No preview if only few cells have to be extracted again
+                if (stride <= 1 || cache->cellsToExtract(settings) < minPreviewCells) {
+                    return Result{extract(volume, *volumeRAM, settings, *cache, stop),
+                                  settings.multipleIsoValues, false};
+                }
+                // The preview has caches of its own, they are not reused
+                const auto [preview, previewRAM] = stridedVolume(*volume, *volumeRAM, stride);
+                Cache previewCache;
+                return Result{extract(preview, *previewRAM, settings, previewCache, stop),
+                              settings.multipleIsoValues, true};
+            },
+            [this](Result result) {
+                finished_ = std::move(result);
+                invalidate(InvalidationLevel::InvalidOutput);
+            });
+    }
 
-        size3_t pos{};
-        for (pos.z = 0; pos.z < dims.z - 1; ++pos.z) {
-            for (pos.y = 0; pos.y < dims.y - 1; ++pos.y) {
-                for (pos.x = 0; pos.x < dims.x - 1; ++pos.x) {
-                    // Step 1: create current cell
+    const MarchingTetrahedra::MeshHelper* MarchingTetrahedra::BrickSurface::find(
+        size_t brick) const {
+        const auto it =
+            std::lower_bound(bricks.begin(), bricks.end(), brick,
+                             [](const auto& mesh, size_t index) { return mesh.first < index; });
+        return it != bricks.end() && it->first == brick ? &it->second : nullptr;
+    }
 
-                    // The DataPoint index should be the 1D-index for the DataPoint in the cell
-                    // Use volume->getAsDouble to query values from the volume
-                    // Spatial position should be between 0 and 1
+    std::shared_ptr<const MarchingTetrahedra::BrickSurface> MarchingTetrahedra::MeshCache::closest(
+        float iso) const {
+        std::shared_ptr<const BrickSurface> result;
+        for (const auto& surface : surfaces) {
+            if (!result || std::abs(surface->iso - iso) < std::abs(result->iso - iso)) {
+                result = surface;
+            }
+        }
+        return result;
+    }
 
-                    Cell c;
+    size_t MarchingTetrahedra::Cache::cellsToExtract(const Settings& settings) const {
+        constexpr size_t brickSize = MinMaxBricks::brickSize;
+        const auto& isoValues = settings.isoValues;
 
-                    //                    int volumeIndex{0};
-                    for (size_t z{ 0 }; z < 2; ++z) {
-                        for (size_t y{ 0 }; y < 2; ++y) {
-                            for (size_t x{ 0 }; x < 2; ++x) {
+        std::vector<std::shared_ptr<const BrickSurface>> previous(isoValues.size());
+        if (meshes && meshes->decomposition == settings.decomposition) {
+            for (size_t k = 0; k < isoValues.size(); ++k) {
+                previous[k] = meshes->closest(isoValues[k]);
+            }
+        }
+
+        size_t count = 0;
+        for (size_t b = 0; b < bricks->minMax.size(); ++b) {
+            const vec2& range = bricks->minMax[b];
+            for (size_t k = 0; k < isoValues.size(); ++k) {
+                if (!bricks->active(b, isoValues[k])) continue;
+                const float lo = previous[k] ? std::min(previous[k]->iso, isoValues[k]) : 0.0f;
+                const float hi = previous[k] ? std::max(previous[k]->iso, isoValues[k]) : 0.0f;
+                if (!previous[k] || (lo < hi && range.x < hi && range.y >= lo)) {
+                    ++count;
+                    break;
+                }
+            }
+        }
+        return count * brickSize * brickSize * brickSize;
+    }
 
-                                // Get index for data point
-                                int index{ calculateDataPointIndexInCell(ivec3{ x, y, z }) };
+    std::vector<std::shared_ptr<Mesh>> MarchingTetrahedra::extract(
+        std::shared_ptr<const Volume> volume, const VolumeRAM& volumeRAM,
+        const Settings& settings, Cache& cache, const TNM067::BackgroundJob::Stop& stop) {
+        constexpr size_t brickSize = MinMaxBricks::brickSize;
+        const size3_t numCells = glm::max(volumeRAM.getDimensions(), size3_t(1)) - size3_t(1);
+        const CellDecomposition decomposition = settings.decomposition;
+        const auto& isoValues = settings.isoValues;
+
+        if (!cache.bricks) {
+            cache.bricks.emplace(volumeRAM);
+        }
+        const auto& bricks = *cache.bricks;
+
+        // The cached surface each iso value starts from, if any
+        std::vector<std::shared_ptr<const BrickSurface>> previous(isoValues.size());
+        const auto& meshCache = cache.meshes;
+        if (meshCache && meshCache->decomposition == decomposition) {
+            for (size_t k = 0; k < isoValues.size(); ++k) {
+                previous[k] = meshCache->closest(isoValues[k]);
+            }
+        }
+        const bool sameOutput = meshCache &&
+                                meshCache->gradientNormals == settings.gradientNormals &&
+                                meshCache->compactOutput == settings.compactOutput;
+        const bool faceNormals = !settings.gradientNormals;
+        const bool cachedFaceNormals = meshCache && !meshCache->gradientNormals;
 
-                                vec3 posGlobal{ pos.x + x, pos.y + y, pos.z + z };
+        // The iso values that need a new output mesh, and the bricks their surfaces cross
+        std::vector<size_t> update;
+        std::vector<float> updateIsoValues;
+        for (size_t k = 0; k < isoValues.size(); ++k) {
+            if (!sameOutput || !previous[k] || previous[k]->iso != isoValues[k]) {
+                update.push_back(k);
+                updateIsoValues.push_back(isoValues[k]);
+            }
+        }
+        std::vector<size_t> active;
+        for (size_t b = 0; b < bricks.minMax.size() && !update.empty(); ++b) {
+            if (bricks.active(b, updateIsoValues)) active.push_back(b);
+        }
 
-                                // Get scaled position
-                                vec3 scaledPos{ calculateDataPointPos(pos, ivec3{ x, y, z }, dims) };
+        // The mesh of each iso value to update in each active brick. Meshes of the cached
+        // surface are moved to the new iso value where no DataPoint of the brick lies between
+        // the two, the others are extracted.
+        const MeshHelper emptyMesh(volume, faceNormals);
+        std::vector<std::vector<MeshHelper>> brickMeshes(active.size());
 
-                                size_t idxInVol{ indexInVolume(posGlobal) };
+        // Edge tables not in use. Each brick takes one and puts it back when done, so there are
+        // at most as many as bricks are extracted at the same time, one per worker.
+        std::mutex edgesMutex;
+        std::vector<EdgeSlices> freeEdges;
 
-                                // Add data point to cell
-                                c.dataPoints[index] = MarchingTetrahedra::DataPoint{ scaledPos, (float)volume->getAsDouble(posGlobal), idxInVol };
+        auto updateBrick = [&](size_t i) {
+            if (stop) return;
+            const size_t b = active[i];
+            const size3_t begin = bricks.brick(b) * brickSize;
+            const size3_t end = glm::min(begin + size3_t(brickSize), numCells);
+            auto& meshes = brickMeshes[i];
+            meshes.assign(update.size(), emptyMesh);
 
-                            }
-                        }
+            std::vector<float> extractIsoValues;
+            std::vector<size_t> extractIndex;
+            for (size_t n = 0; n < update.size(); ++n) {
+                const float iso = updateIsoValues[n];
+                if (!bricks.active(b, iso)) continue;
+                const auto& cached = previous[update[n]];
+                const MeshHelper* mesh = cached ? cached->find(b) : nullptr;
+                if (mesh && !anyValueBetween(volumeRAM, begin, end, std::min(cached->iso, iso),
+                                             std::max(cached->iso, iso))) {
+                    meshes[n] = *mesh;
+                    if (cached->iso != iso) meshes[n].reinterpolate(volumeRAM, iso);
+                    if (faceNormals && (cached->iso != iso || !cachedFaceNormals)) {
+                        meshes[n].computeFaceNormals();
                     }
+                } else {
+                    extractIsoValues.push_back(iso);
+                    extractIndex.push_back(n);
+                }
+            }
+            if (extractIsoValues.empty()) return;
 
-                    // Step 2: Subdivide cell into tetrahedra (hint: use tetrahedraIds)
-                    std::vector<Tetrahedra> tetrahedras;
-                    for (size_t t{ 0 }; t < 6; ++t) {
-                        Tetrahedra tetra{};
-                        for (size_t p{ 0 }; p < 4; ++p) {
-                            tetra.dataPoints[p] = c.dataPoints[tetrahedraIds[t][p]];
-                        }
-                        tetrahedras.push_back(tetra);
-                    }
+            std::optional<EdgeSlices> edges;
+            {
+                std::lock_guard<std::mutex> lock(edgesMutex);
+                if (!freeEdges.empty()) {
+                    edges.emplace(std::move(freeEdges.back()));
+                    freeEdges.pop_back();
+                }
+            }
+            if (!edges) edges.emplace(volumeRAM.getDimensions(), decomposition, update.size());
+            std::vector<MeshHelper> extracted(extractIsoValues.size(), emptyMesh);
+            extractSurface(volumeRAM, begin, end, extractIsoValues, decomposition, bricks,
+                           extracted, *edges, stop);
+            {
+                std::lock_guard<std::mutex> lock(edgesMutex);
+                freeEdges.push_back(std::move(*edges));
+            }
+            for (size_t n = 0; n < extracted.size(); ++n) {
+                meshes[extractIndex[n]] = std::move(extracted[n]);
+            }
+        };
+        if (settings.parallel) {
+            TNM067::parallelFor(active.size(), updateBrick);
+        } else {
+            for (size_t i = 0; i < active.size(); ++i) updateBrick(i);
+        }
+        // Bricks may be incomplete
+        if (stop) return {};
 
+        std::vector<std::shared_ptr<Mesh>> result(isoValues.size());
+        MeshCache newCache{decomposition, settings.gradientNormals, settings.compactOutput, {}};
+        for (size_t k = 0; k < isoValues.size(); ++k) {
+            if (std::find(update.begin(), update.end(), k) == update.end()) {
+                result[k] = previous[k]->mesh;
+                newCache.surfaces.push_back(previous[k]);
+            }
+        }
+        for (size_t n = 0; n < update.size(); ++n) {
+            auto surface = std::make_shared<BrickSurface>();
+            surface->iso = updateIsoValues[n];
+            for (size_t i = 0; i < active.size(); ++i) {
+                auto& mesh = brickMeshes[i][n];
+                if (!mesh.empty()) surface->bricks.emplace_back(active[i], std::move(mesh));
+            }
 
-                    // Step three: Calculate for tetra case index
-                    for (const Tetrahedra& tetrahedra : tetrahedras) {
-                        int caseId = 0;
+            std::vector<const MeshHelper*> parts;
+            for (const auto& brick : surface->bricks) parts.push_back(&brick.second);
+            MeshHelper mesh = parts.empty() ? emptyMesh : MeshHelper::merge(parts);
+            if (settings.gradientNormals) {
+                mesh.computeGradientNormals(volumeRAM, surface->iso);
+            }
+            if (settings.compactOutput) {
+                surface->mesh = mesh.toCompactMesh();
+            } else {
+                surface->mesh = mesh.toBasicMesh();
+            }
 
-                        for (size_t point{ 0 }; point < 4; ++point) {
-                            if (tetrahedra.dataPoints[point].value < iso) {
-                                caseId += (int)glm::pow(2.0, (double)point);
-                            }
-                        }
+            result[update[n]] = surface->mesh;
+            newCache.surfaces.push_back(std::move(surface));
+        }
+        cache.meshes = std::move(newCache);
+        return result;
+    }
 
+    void MarchingTetrahedra::extractSurface(const VolumeRAM& volume, size3_t begin, size3_t end,
+                                            const std::vector<float>& isoValues,
+                                            CellDecomposition decomposition,
+                                            const MinMaxBricks& bricks,
+                                            std::vector<MeshHelper>& meshes, EdgeSlices& edges,
+                                            const TNM067::BackgroundJob::Stop& stop) {
+        constexpr size_t brickSize = MinMaxBricks::brickSize;
+        const auto& dims = volume.getDimensions();
 
-                        // step four: Extract triangles
-                        switch (caseId) {
-                        case 0: case 15:
-                        break;
-                        case 1: case 14: { // Point normals in different directions
-                            if (caseId == 1) { // 0->1, 0->2, 0->3
-                                createTriangle(TriEdge{ 0, 1 }, TriEdge{ 0, 2 }, TriEdge{ 0, 3 }, iso, tetrahedra, mesh);
-                            }
-                            else { // 0->1, 0->3, 0->2
-                                createTriangle(TriEdge{ 0, 1 }, TriEdge{ 0, 3 }, TriEdge{ 0, 2 }, iso, tetrahedra, mesh);
-                            }
-                            break;
-                        }
-                        case 2: case 13: { // Point normals in different directions
-                            if (caseId == 2) { // 1->0, 1->3, 1->2
-                                createTriangle(TriEdge{ 1, 0 }, TriEdge{ 1, 3 }, TriEdge{ 1, 2 }, iso, tetrahedra, mesh);
-                            }
-                            else { // 1->0, 1->2, 1->3
-                                createTriangle(TriEdge{ 1, 0 }, TriEdge{ 1, 2 }, TriEdge{ 1, 3 }, iso, tetrahedra, mesh);
-                            }
-                            break;
-                        }
-                        case 3: case 12: { // Point normals in different directions
-                            if (caseId == 3) {
-                                // left: 0->3, 1->3, 1->2
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 1, 3 }, TriEdge{ 1, 2 }, iso, tetrahedra, mesh);
-                                // right: 0->3, 1->2, 0->2
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 1, 2 }, TriEdge{ 0, 2 }, iso, tetrahedra, mesh);
-                            }
-                            else {
-                                // left: 0->3, 1->2, 1->3
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 1, 2 }, TriEdge{ 1, 3 }, iso, tetrahedra, mesh);
-                                // right: 0->3, 0->2, 1->2
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 0, 2 }, TriEdge{ 1, 2 }, iso, tetrahedra, mesh);
-                            }
-                            break;
-                        }
-                        case 4: case 11: { // Point normals in different directions
-                            if (caseId == 4) { // 2->0, 2->1, 2->3
-                                createTriangle(TriEdge{ 2, 0 }, TriEdge{ 2, 1 }, TriEdge{ 2, 3 }, iso, tetrahedra, mesh);
-                            }
-                            else { // 2->0, 2->3, 2->1
-                                createTriangle(TriEdge{ 2, 0 }, TriEdge{ 2, 3 }, TriEdge{ 2, 1 }, iso, tetrahedra, mesh);
+        util::IndexMapper3D indexInVolume(dims);
+        const auto& cubes = cubeCases();
+
+        // Spatial position of the DataPoints of the cells along each axis, as in
+        // calculateDataPointPos, from begin on
+        std::array<std::vector<float>, 3> coordinates;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            coordinates[axis].resize(end[axis] + 1 - begin[axis]);
+            for (size_t i = 0; i < coordinates[axis].size(); ++i) {
+                coordinates[axis][i] = static_cast<float>(begin[axis] + i) /
+                                       static_cast<float>(static_cast<int>(dims[axis]) - 1);
+            }
+        }
+
+        // The values of the DataPoints of the cells in the two z-planes of the current layer,
+        // plane z in planes[z % 2]
+        const size2_t planeDims(end.x + 1 - begin.x, end.y + 1 - begin.y);
+        std::array<std::vector<float>, 2> planes{std::vector<float>(planeDims.x * planeDims.y),
+                                                 std::vector<float>(planeDims.x * planeDims.y)};
+        auto load = [&](size_t z) {
+            loadPlane(volume, size3_t(begin.x, begin.y, z), planeDims, planes[z % 2]);
+        };
+
+        edges.clear(begin, end);
+        size3_t pos{};
+        for (pos.z = begin.z; pos.z < end.z && !stop; ++pos.z) {
+            edges.beginLayer(pos.z);
+            if (pos.z == begin.z) load(pos.z);
+            load(pos.z + 1);
+
+            for (pos.y = begin.y; pos.y < end.y; ++pos.y) {
+                // The cell of the previous x, its DataPoints at x + 1 are reused
+                Cell c;
+                size_t cellX = std::numeric_limits<size_t>::max();
+
+                for (pos.x = begin.x; pos.x < end.x; ++pos.x) {
+                    // Skip the rest of the brick along x if it cannot intersect the iso surface
+                    if (!bricks.active(pos / brickSize, isoValues)) {
+                        pos.x = (pos.x / brickSize + 1) * brickSize - 1;
+                        continue;
+                    }
+
+                    // Step 1: create current cell
+                    const bool shared = pos.x > 0 && cellX + 1 == pos.x;
+                    cellX = pos.x;
+                    for (size_t z{ 0 }; z < 2; ++z) {
+                        for (size_t y{ 0 }; y < 2; ++y) {
+                            for (size_t x{ 0 }; x < 2; ++x) {
+                                const int index{ calculateDataPointIndexInCell(ivec3(x, y, z)) };
+                                if (x == 0 && shared) {
+                                    c.dataPoints[index] =
+                                        c.dataPoints[calculateDataPointIndexInCell(ivec3(1, y, z))];
+                                    continue;
+                                }
+
+                                const size3_t posGlobal{ pos.x + x, pos.y + y, pos.z + z };
+                                const size_t localX = posGlobal.x - begin.x;
+                                const size_t localY = posGlobal.y - begin.y;
+                                c.dataPoints[index] = MarchingTetrahedra::DataPoint{
+                                    vec3(coordinates[0][localX], coordinates[1][localY],
+                                         coordinates[2][posGlobal.z - begin.z]),
+                                    planes[posGlobal.z % 2][localX + localY * planeDims.x],
+                                    indexInVolume(posGlobal) };
                             }
-                            break;
                         }
-                        case 5: case 10: { // Point normals in different directions
-                            if (caseId == 5) {
-                                // left: 0->3, 0->1, 1->2
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 0, 1 }, TriEdge{ 1, 2 }, iso, tetrahedra, mesh);
-                                // right: 0->3, 1->2, 2->3
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 1, 2 }, TriEdge{ 2, 3 }, iso, tetrahedra, mesh);
-                            }
-                            else {
-                                // left: 0->3, 1->2, 0->1
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 1, 2 }, TriEdge{ 0, 1 }, iso, tetrahedra, mesh);
-                                // right: 0->3, 2->3, 1->2
-                                createTriangle(TriEdge{ 0, 3 }, TriEdge{ 2, 3 }, TriEdge{ 1, 2 }, iso, tetrahedra, mesh);
-                            }
-                            break;
+                    }
+
+                    const Decomposition& tetrahedra =
+                        decomposition == CellDecomposition::FiveTetrahedra
+                            ? fiveTetrahedra[(pos.x + pos.y + pos.z) % 2]
+                            : sixTetrahedra;
+
+                    for (size_t i = 0; i < isoValues.size(); ++i) {
+                        const float iso = isoValues[i];
+                        auto& mesh = meshes[i];
+
+                        // Step 2: Case of the cell, bit k set if DataPoint k is below the iso
+                        // value
+                        unsigned cellCase = 0;
+                        for (unsigned k = 0; k < 8; ++k) {
+                            cellCase |= static_cast<unsigned>(c.dataPoints[k].value < iso) << k;
                         }
-                        case 6: case 9: { // Point normals in different directions
-                            if (caseId == 6) {
-                                // left: 0->2, 0->1, 1->3
-                                createTriangle(TriEdge{ 0, 2 }, TriEdge{ 0, 1 }, TriEdge{ 1, 3 }, iso, tetrahedra, mesh);
-                                // right: 0->2, 1->3, 3->2
-                                createTriangle(TriEdge{ 0, 2 }, TriEdge{ 1, 3 }, TriEdge{ 3, 2 }, iso, tetrahedra, mesh);
+                        if (cellCase == 0 || cellCase == 0xFF) continue;
+
+                        auto addTriangle = [&](const Triangle& triangle) {
+                            std::uint32_t vertices[3];
+                            for (size_t e = 0; e < 3; ++e) {
+                                const auto& origin = c.dataPoints[triangle[e][0]];
+                                const auto& dest = c.dataPoints[triangle[e][1]];
+                                auto& vertex = edges(std::min(origin.index, dest.index),
+                                                     std::max(origin.index, dest.index), i);
+                                if (vertex == EdgeSlices::none) {
+                                    const vec3 p =
+                                        origin.pos + (dest.pos - origin.pos) *
+                                                         ((iso - origin.value) /
+                                                          (dest.value - origin.value));
+                                    vertex = mesh.addVertex(p, origin.index, dest.index);
+                                }
+                                vertices[e] = vertex;
                             }
-                            else {
-                                // left: 0->2, 1->3, 0->1
-                                createTriangle(TriEdge{ 0, 2 }, TriEdge{ 1, 3 }, TriEdge{ 0, 1 }, iso, tetrahedra, mesh);
-                                // right: 0->2, 3->2, 1->3
-                                createTriangle(TriEdge{ 0, 2 }, TriEdge{ 3, 2 }, TriEdge{ 1, 3 }, iso, tetrahedra, mesh);
+                            mesh.addTriangle(vertices[0], vertices[1], vertices[2]);
+                        };
+
+                        // Step 3: Extract the triangles of the cell, or of each tetrahedron
+                        if (decomposition == CellDecomposition::Cubes) {
+                            const auto& cube = cubes[cellCase];
+                            for (size_t n = 0; n < cube.count; ++n) {
+                                addTriangle(cube.triangles[n]);
                             }
-                            break;
+                            continue;
                         }
-                        case 7: case 8: { // Point normals in different directions
-                            if (caseId == 7) { // 1->3, 2->3, 0->3
-                                createTriangle(TriEdge{ 1, 3 }, TriEdge{ 2, 3 }, TriEdge{ 0, 3 }, iso, tetrahedra, mesh);
-                            }
-                            else { // 1->3, 0->3, 2->3
-                                createTriangle(TriEdge{ 1, 3 }, TriEdge{ 0, 3 }, TriEdge{ 2, 3 }, iso, tetrahedra, mesh);
+                        for (size_t t = 0; t < tetrahedra.count; ++t) {
+                            const auto& tetra = tetrahedra.cases[t][tetrahedronCase(
+                                cellCase, tetrahedra.tetrahedra[t])];
+                            for (size_t n = 0; n < tetra.count; ++n) {
+                                addTriangle(tetra.triangles[n]);
                             }
-                            break;
-                        }
                         }
                     }
                 }
             }
         }
+    }
+
+    MarchingTetrahedra::MinMaxBricks::MinMaxBricks(const VolumeRAM& volume) {
+        const size3_t dims = volume.getDimensions();
+        const size3_t numCells = glm::max(dims, size3_t(1)) - size3_t(1);
+        numBricks = (numCells + size3_t(brickSize - 1)) / brickSize;
+        minMax.resize(numBricks.x * numBricks.y * numBricks.z);
 
-        mesh_.setData(mesh.toBasicMesh());
+        volume.dispatch<void>([&](const auto vr) {
+            const auto data = vr->getDataTyped();
+            util::IndexMapper3D index(dims);
+
+            TNM067::parallelFor(minMax.size(), [&](size_t i) {
+                const size3_t brick{i % numBricks.x, (i / numBricks.x) % numBricks.y,
+                                    i / (numBricks.x * numBricks.y)};
+                // The DataPoints of the cells, including those shared with the next brick
+                const size3_t begin = brick * brickSize;
+                const size3_t end = glm::min(begin + size3_t(brickSize + 1), dims);
+
+                vec2 range{std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+                for (size_t z = begin.z; z < end.z; ++z) {
+                    for (size_t y = begin.y; y < end.y; ++y) {
+                        for (size_t x = begin.x; x < end.x; ++x) {
+                            const auto value =
+                                static_cast<float>(util::glmcomp(data[index(size3_t(x, y, z))], 0));
+                            range.x = std::min(range.x, value);
+                            range.y = std::max(range.y, value);
+                        }
+                    }
+                }
+                minMax[i] = range;
+            });
+        });
     }
 
     int MarchingTetrahedra::calculateDataPointIndexInCell(ivec3 index3D) {
@@ -254,24 +917,29 @@ namespace inviwo {
         return vec3{ (posVolVec + posCellVec) / dimsVec };
     }
 
-    MarchingTetrahedra::MeshHelper::MeshHelper(std::shared_ptr<const Volume> vol)
-        : edgeToVertex_()
+    MarchingTetrahedra::MeshHelper::MeshHelper(std::shared_ptr<const Volume> vol,
+                                               bool faceNormals)
+        : volume_(vol)
+        , faceNormals_(faceNormals)
         , vertices_()
-        , mesh_(std::make_shared<BasicMesh>())
-        , indexBuffer_(mesh_->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)) {
-        mesh_->setModelMatrix(vol->getModelMatrix());
-        mesh_->setWorldMatrix(vol->getWorldMatrix());
-    }
+        , vertexEdges_()
+        , indices_() {}
 
     void MarchingTetrahedra::MeshHelper::addTriangle(size_t i0, size_t i1, size_t i2) {
         IVW_ASSERT(i0 != i1, "i0 and i1 should not be the same value");
         IVW_ASSERT(i0 != i2, "i0 and i2 should not be the same value");
         IVW_ASSERT(i1 != i2, "i1 and i2 should not be the same value");
 
-        indexBuffer_->add(static_cast<glm::uint32_t>(i0));
-        indexBuffer_->add(static_cast<glm::uint32_t>(i1));
-        indexBuffer_->add(static_cast<glm::uint32_t>(i2));
+        indices_.push_back(static_cast<glm::uint32_t>(i0));
+        indices_.push_back(static_cast<glm::uint32_t>(i1));
+        indices_.push_back(static_cast<glm::uint32_t>(i2));
+
+        if (faceNormals_) {
+            addFaceNormal(i0, i1, i2);
+        }
+    }
 
+    void MarchingTetrahedra::MeshHelper::addFaceNormal(size_t i0, size_t i1, size_t i2) {
         const auto a = std::get<0>(vertices_[i0]);
         const auto b = std::get<0>(vertices_[i1]);
         const auto c = std::get<0>(vertices_[i2]);
@@ -283,23 +951,288 @@ namespace inviwo {
     }
 
     std::shared_ptr<BasicMesh> MarchingTetrahedra::MeshHelper::toBasicMesh() {
+        auto mesh = std::make_shared<BasicMesh>();
+        mesh->setModelMatrix(volume_->getModelMatrix());
+        mesh->setWorldMatrix(volume_->getWorldMatrix());
+        mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)->getDataContainer() =
+            std::move(indices_);
+
         for (auto& vertex : vertices_) {
             // Normalize the normal of the vertex
             std::get<1>(vertex) = glm::normalize(std::get<1>(vertex));
         }
-        mesh_->addVertices(vertices_);
-        return mesh_;
+        mesh->addVertices(vertices_);
+        return mesh;
+    }
+
+    std::shared_ptr<Mesh> MarchingTetrahedra::MeshHelper::toCompactMesh() {
+        constexpr float quantization = 65535.0f;
+
+        auto mesh = std::make_shared<Mesh>();
+        mat4 dequantize(1.0f / quantization);
+        dequantize[3][3] = 1.0f;
+        mesh->setModelMatrix(volume_->getModelMatrix() * dequantize);
+        mesh->setWorldMatrix(volume_->getWorldMatrix());
+
+        std::vector<glm::u16vec3> positions(vertices_.size());
+        std::vector<glm::i16vec2> normals(vertices_.size());
+        constexpr size_t blockSize = 4096;
+        TNM067::parallelFor((vertices_.size() + blockSize - 1) / blockSize, [&](size_t b) {
+            const size_t end = std::min((b + 1) * blockSize, vertices_.size());
+            for (size_t v = b * blockSize; v < end; ++v) {
+                const vec3 pos = glm::clamp(std::get<0>(vertices_[v]), vec3(0.0f), vec3(1.0f));
+                positions[v] = glm::u16vec3(glm::round(pos * quantization));
+                normals[v] = encodeOctahedron(std::get<1>(vertices_[v]));
+            }
+        });
+        vertices_.clear();
+        vertexEdges_.clear();
+
+        mesh->addBuffer(BufferType::PositionAttrib, util::makeBuffer(std::move(positions)));
+        mesh->addBuffer(BufferType::NormalAttrib, util::makeBuffer(std::move(normals)));
+        mesh->addIndices(Mesh::MeshInfo(DrawType::Triangles, ConnectivityType::None),
+                         util::makeIndexBuffer(std::move(indices_)));
+        return mesh;
+    }
+
+    void MarchingTetrahedra::MeshHelper::computeGradientNormals(const VolumeRAM& volume,
+                                                                float iso) {
+        const size3_t dims = volume.getDimensions();
+        // Differences are per DataPoint, while the positions span [0, 1]
+        const vec3 scale = 0.5f * vec3(glm::max(dims, size3_t(2)) - size3_t(1));
+
+        volume.dispatch<void>([&](const auto vr) {
+            const auto data = vr->getDataTyped();
+            util::IndexMapper3D indexInVolume(dims);
+            auto value = [&](size_t index) {
+                return static_cast<float>(util::glmcomp(data[index], 0));
+            };
+            // Twice the central difference, one-sided at the border
+            auto gradient = [&](size_t index) {
+                const size3_t pos(index % dims.x, (index / dims.x) % dims.y,
+                                  index / (dims.x * dims.y));
+                vec3 g;
+                for (int axis = 0; axis < 3; ++axis) {
+                    size3_t prev = pos;
+                    size3_t next = pos;
+                    if (prev[axis] > 0) --prev[axis];
+                    if (next[axis] + 1 < dims[axis]) ++next[axis];
+                    const float steps = static_cast<float>(next[axis] - prev[axis]);
+                    g[axis] = steps > 0.0f ? (value(indexInVolume(next)) -
+                                              value(indexInVolume(prev))) * 2.0f / steps
+                                           : 0.0f;
+                }
+                return g * scale;
+            };
+
+            constexpr size_t blockSize = 4096;
+            TNM067::parallelFor((vertices_.size() + blockSize - 1) / blockSize, [&](size_t b) {
+                const size_t end = std::min((b + 1) * blockSize, vertices_.size());
+                for (size_t v = b * blockSize; v < end; ++v) {
+                    const auto& edge = vertexEdges_[v];
+                    const float vi = value(edge.first);
+                    const float vj = value(edge.second);
+                    const float t = vi != vj ? glm::clamp((iso - vi) / (vj - vi), 0.0f, 1.0f)
+                                             : 0.5f;
+                    // The triangles face towards higher values, like the gradient
+                    std::get<1>(vertices_[v]) =
+                        glm::mix(gradient(edge.first), gradient(edge.second), t);
+                }
+            });
+        });
+    }
+
+    void MarchingTetrahedra::MeshHelper::computeFaceNormals() {
+        for (auto& vertex : vertices_) {
+            std::get<1>(vertex) = vec3(0.0f);
+        }
+        for (size_t i = 0; i + 2 < indices_.size(); i += 3) {
+            addFaceNormal(indices_[i], indices_[i + 1], indices_[i + 2]);
+        }
+    }
+
+    void MarchingTetrahedra::MeshHelper::reinterpolate(const VolumeRAM& volume, float iso) {
+        const size3_t dims = volume.getDimensions();
+        // Spatial position of a DataPoint, as in calculateDataPointPos
+        auto position = [&](size_t index) {
+            const size3_t pos(index % dims.x, (index / dims.x) % dims.y,
+                              index / (dims.x * dims.y));
+            vec3 p;
+            for (int axis = 0; axis < 3; ++axis) {
+                p[axis] = static_cast<float>(pos[axis]) /
+                          static_cast<float>(static_cast<int>(dims[axis]) - 1);
+            }
+            return p;
+        };
+
+        volume.dispatch<void>([&](const auto vr) {
+            const auto data = vr->getDataTyped();
+            auto value = [&](size_t index) {
+                return static_cast<float>(util::glmcomp(data[index], 0));
+            };
+            for (size_t v = 0; v < vertices_.size(); ++v) {
+                const auto& edge = vertexEdges_[v];
+                // The edge is crossed, so the values differ
+                const float vi = value(edge.first);
+                const float vj = value(edge.second);
+                const vec3 pi = position(edge.first);
+                const vec3 p = pi + (position(edge.second) - pi) * ((iso - vi) / (vj - vi));
+                std::get<0>(vertices_[v]) = p;
+                std::get<2>(vertices_[v]) = p;
+            }
+        });
+    }
+
+    MarchingTetrahedra::MeshHelper MarchingTetrahedra::MeshHelper::merge(
+        const std::vector<const MeshHelper*>& bricks) {
+        constexpr size_t brickSize = MinMaxBricks::brickSize;
+        MeshHelper result(bricks.front()->volume_, bricks.front()->faceNormals_);
+        const size3_t dims = result.volume_->getDimensions();
+
+        size_t numVertices = 0;
+        size_t numIndices = 0;
+        for (const auto brick : bricks) {
+            numVertices += brick->vertices_.size();
+            numIndices += brick->indices_.size();
+        }
+        result.vertices_.reserve(numVertices);
+        result.vertexEdges_.reserve(numVertices);
+        result.indices_.reserve(numIndices);
+
+        // True if the edge lies in a face between two bricks, only those can have a vertex in
+        // more than one brick. The second DataPoint is only looked at if the first lies in such
+        // a face, which most do not.
+        auto position = [&](size_t index) {
+            const size_t row = index / dims.x;
+            return size3_t(index - row * dims.x, row % dims.y, row / dims.y);
+        };
+        auto inFace = [&](const size3_t& pos, int axis) {
+            return pos[axis] % brickSize == 0 && pos[axis] > 0 && pos[axis] + 1 < dims[axis];
+        };
+        auto betweenBricks = [&](const std::pair<size_t, size_t>& edge) {
+            const size3_t i = position(edge.first);
+            if (!inFace(i, 0) && !inFace(i, 1) && !inFace(i, 2)) return false;
+            const size3_t j = position(edge.second);
+            for (int axis = 0; axis < 3; ++axis) {
+                if (i[axis] == j[axis] && inFace(i, axis)) return true;
+            }
+            return false;
+        };
+
+        // Index in result of the vertices on edges between bricks
+        std::unordered_map<std::pair<size_t, size_t>, std::uint32_t, EdgeHash> shared;
+        shared.reserve(numVertices / 2);
+        std::vector<std::uint32_t> toResult;
+        for (const auto brick : bricks) {
+            toResult.resize(brick->vertices_.size());
+            for (size_t v = 0; v < brick->vertices_.size(); ++v) {
+                const auto& edge = brick->vertexEdges_[v];
+                const auto index = static_cast<std::uint32_t>(result.vertices_.size());
+                if (betweenBricks(edge)) {
+                    const auto [it, inserted] = shared.emplace(edge, index);
+                    if (!inserted) {
+                        toResult[v] = it->second;
+                        std::get<1>(result.vertices_[it->second]) +=
+                            std::get<1>(brick->vertices_[v]);
+                        continue;
+                    }
+                }
+                toResult[v] = index;
+                result.vertices_.push_back(brick->vertices_[v]);
+                result.vertexEdges_.push_back(edge);
+            }
+            for (auto index : brick->indices_) {
+                result.indices_.push_back(toResult[index]);
+            }
+        }
+
+        return result;
     }
 
     std::uint32_t MarchingTetrahedra::MeshHelper::addVertex(vec3 pos, size_t i, size_t j) {
         IVW_ASSERT(i != j, "i and j should not be the same value");
         if (j < i) std::swap(i, j);
 
-        auto [edgeIt, inserted] = edgeToVertex_.try_emplace(std::make_pair(i, j), vertices_.size());
-        if (inserted) {
-            vertices_.push_back({ pos, vec3(0, 0, 0), pos, vec4(0.7f, 0.7f, 0.7f, 1.0f) });
+        const auto vertex = static_cast<std::uint32_t>(vertices_.size());
+        vertices_.push_back({ pos, vec3(0, 0, 0), pos, vec4(0.7f, 0.7f, 0.7f, 1.0f) });
+        vertexEdges_.emplace_back(i, j);
+        return vertex;
+    }
+
+    MarchingTetrahedra::EdgeSlices::EdgeSlices(size3_t dims, CellDecomposition decomposition,
+                                               size_t numIsoValues)
+        : dims_(dims)
+        , numIsoValues_(numIsoValues)
+        , numSlots_(0)
+        , slots_()
+        , begin_(0)
+        , size_(0)
+        , planeSize_(0)
+        , layer_(std::numeric_limits<size_t>::max())
+        , edges_()
+        , blocks_() {
+        const auto used = edgeDirections(decomposition);
+        for (size_t d = 0; d < used.size(); ++d) {
+            slots_[d] = used[d] ? static_cast<std::uint8_t>(numSlots_++)
+                                : std::numeric_limits<std::uint8_t>::max();
+        }
+    }
+
+    void MarchingTetrahedra::EdgeSlices::clear(size3_t begin, size3_t end) {
+        begin_ = size2_t(begin.x, begin.y);
+        size_ = size2_t(end.x + 1 - begin.x, end.y + 1 - begin.y);
+        planeSize_ = size_.x * size_.y;
+        if (edges_.size() < 2 * planeSize_ * numSlots_) {
+            edges_.resize(2 * planeSize_ * numSlots_);
+        }
+        layer_ = std::numeric_limits<size_t>::max();
+    }
+
+    void MarchingTetrahedra::EdgeSlices::resetPlane(size_t z) {
+        const auto begin = edges_.begin() + (z % 2) * planeSize_ * numSlots_;
+        std::fill(begin, begin + planeSize_ * numSlots_, none);
+        blocks_[z % 2].clear();
+    }
+
+    void MarchingTetrahedra::EdgeSlices::beginLayer(size_t z) {
+        // Plane z + 1 takes the place of plane z - 1. After clear, layer_ + 1 wraps to 0, so
+        // the first layer of a range starting at z = 0 has to be excluded explicitly.
+        if (z == 0 || layer_ + 1 != z) resetPlane(z);
+        resetPlane(z + 1);
+        layer_ = z;
+    }
+
+    std::uint32_t& MarchingTetrahedra::EdgeSlices::operator()(size_t i, size_t j,
+                                                              size_t isoIndex) {
+        IVW_ASSERT(i < j, "i has to be smaller than j");
+        IVW_ASSERT(isoIndex < numIsoValues_, "More iso values than the edges were made for");
+        const size_t volumePlane = dims_.x * dims_.y;
+        const size_t z = i / volumePlane;
+        const size_t inVolumePlane = i % volumePlane;
+        const size_t x = inVolumePlane % dims_.x;
+        const size_t y = inVolumePlane / dims_.x;
+        const auto dx = static_cast<std::ptrdiff_t>(j % dims_.x) - static_cast<std::ptrdiff_t>(x);
+        const auto dy = static_cast<std::ptrdiff_t>((j / dims_.x) % dims_.y) -
+                        static_cast<std::ptrdiff_t>(y);
+        const auto dz = static_cast<std::ptrdiff_t>(j / volumePlane - z);
+        IVW_ASSERT(z == layer_ || z == layer_ + 1, "Edge outside of the current layer");
+        IVW_ASSERT(x - begin_.x < size_.x && y - begin_.y < size_.y, "Edge outside of the range");
+
+        // The 13 neighbours with higher index have (dx+1) + 3(dy+1) + 9(dz+1) in [14, 26]
+        const auto slot = slots_[static_cast<size_t>((dx + 1) + 3 * (dy + 1) + 9 * (dz + 1) - 14)];
+        IVW_ASSERT(slot != std::numeric_limits<std::uint8_t>::max(),
+                   "Edge direction not in the cell decomposition");
+        const size_t inPlane = (x - begin_.x) + (y - begin_.y) * size_.x;
+        auto& entry = edges_[((z % 2) * planeSize_ + inPlane) * numSlots_ + slot];
+        if (numIsoValues_ == 1) return entry;
+
+        // First iso surface crossing the edge, give it a block
+        auto& blocks = blocks_[z % 2];
+        if (entry == none) {
+            entry = static_cast<std::uint32_t>(blocks.size() / numIsoValues_);
+            blocks.resize(blocks.size() + numIsoValues_, none);
         }
-        return static_cast<std::uint32_t>(edgeIt->second);
+        return blocks[entry * numIsoValues_ + isoIndex];
     }
 
 }  // namespace inviwo
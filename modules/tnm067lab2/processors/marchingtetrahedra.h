@@ -3,33 +3,33 @@
 #include <modules/tnm067lab2/tnm067lab2moduledefine.h>
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
 #include <inviwo/core/ports/imageport.h>
 #include <inviwo/core/ports/volumeport.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
 #include <inviwo/core/ports/meshport.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <modules/tnm067lab1/utils/backgroundjob.h>
 
-namespace inviwo {
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
 
-struct TriEdge{
-    int origin, dest; // origin and destination index
-    
-    TriEdge(int o, int d){
-        origin = o;
-        dest = d;
-    }
-};
+namespace inviwo {
 
 class IVW_MODULE_TNM067LAB2_API MarchingTetrahedra : public Processor {
 public:
-    struct HashFunc {
-        static size_t max;
-        size_t operator()(std::pair<size_t, size_t> p) const {
-            size_t asdf;
-            asdf = p.first;
-            asdf += p.second * max;
-            return std::hash<size_t>{}(asdf);
-        }
-    };
+    /**
+     * SixTetrahedra: every cell is split into the same six tetrahedra around its main diagonal.
+     * FiveTetrahedra: every cell is split into five tetrahedra, alternating between two mirrored
+     * splits by the parity of x + y + z.
+     * Cubes: no split, every cell is triangulated as a whole by marching cubes.
+     */
+    enum class CellDecomposition { SixTetrahedra, FiveTetrahedra, Cubes };
 
     struct DataPoint {
         vec3 pos;
@@ -45,16 +45,77 @@ public:
         DataPoint dataPoints[4];
     };
 
+    /**
+     * Vertex indices of the edges between neighbouring DataPoints of the volume, for the
+     * DataPoints of a range of cells in two consecutive z-planes and the meshes of numIsoValues
+     * iso values. An edge is stored at its DataPoint with the lower index, in one of the
+     * directions towards a neighbour with higher index. Only the directions of the edges of the
+     * cell decomposition are stored: 3 for marching cubes, 7 for six and 9 for five tetrahedra,
+     * out of 13. The two planes are reused as a ring buffer while moving through the range one
+     * layer of cells at a time.
+     *
+     * The table has one entry per edge, 2 * (w + 1) * (h + 1) * directions 32-bit integers for a
+     * range of w x h cells in x and y, about 19 MB for a whole 512 x 512 plane with five
+     * tetrahedra and 6 kB for a brick of MinMaxBricks. With a single iso value the entry is the
+     * vertex index. With more, it refers to a block of numIsoValues vertex indices, which is only
+     * allocated when an iso surface crosses the edge. The memory does therefore not grow with
+     * the number of iso values, except for the edges that are actually crossed.
+     */
+    class EdgeSlices {
+    public:
+        static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
+        EdgeSlices(size3_t dims, CellDecomposition decomposition, size_t numIsoValues);
+
+        /**
+         * Forgets all edges, for extracting the cells with begin <= pos < end into new meshes.
+         * The table grows to the largest range it is used for.
+         */
+        void clear(size3_t begin, size3_t end);
+
+        /**
+         * Prepares for the cells between the planes z and z + 1. Keeps the edges of plane z if
+         * the previous layer was z - 1, all other entries are reset to none.
+         */
+        void beginLayer(size_t z);
+
+        /**
+         * Vertex index of the edge between the DataPoints with index i < j in the mesh of iso
+         * value isoIndex, or none. Both DataPoints have to be in the current layer of cells of
+         * the range. The reference is valid until the next call.
+         */
+        std::uint32_t& operator()(size_t i, size_t j, size_t isoIndex);
+
+    private:
+        void resetPlane(size_t z);
+
+        size3_t dims_;
+        size_t numIsoValues_;
+        size_t numSlots_;  // Entries per DataPoint
+        std::array<std::uint8_t, 13> slots_;  // Slot of each of the 13 directions
+        size2_t begin_;  // First DataPoint of the range in x and y
+        size2_t size_;   // DataPoints of the range in x and y
+        size_t planeSize_;
+        size_t layer_;
+        // numSlots_ per DataPoint, two planes. The vertex, or the block in blocks_ of the plane.
+        std::vector<std::uint32_t> edges_;
+        std::array<std::vector<std::uint32_t>, 2> blocks_;  // numIsoValues_ vertices per block
+    };
+
     struct MeshHelper {
 
-        MeshHelper(std::shared_ptr<const Volume> vol);
+        /**
+         * If faceNormals is true, addTriangle adds the normal of the triangle to its vertices.
+         * Otherwise the normals are left for computeGradientNormals.
+         */
+        MeshHelper(std::shared_ptr<const Volume> vol, bool faceNormals = true);
 
         /**
          * Adds a vertex to the mesh. The input parameters i and j are the DataPoint-indices of the two
-         * DataPoints spanning the edge on which the vertex lies. The vertex will only be added created
-         * if a vertex between the same indices has not been added before. Will return the index of
-         * the created vertex or the vertex that was created for this edge before. The DataPoint-index i
-         * and j can be given in any order.
+         * DataPoints spanning the edge on which the vertex lies. Will return the index of the
+         * created vertex. The DataPoint-index i and j can be given in any order. The vertices of
+         * edges that already have one are looked up in EdgeSlices by extractSurface, which shares
+         * one EdgeSlices among the meshes of all iso values.
          *
          * @param pos spatial position of the vertex
          * @param i DataPoint index of first DataPoint of the edge
@@ -64,11 +125,83 @@ public:
         void addTriangle(size_t i0, size_t i1, size_t i2);
         std::shared_ptr<BasicMesh> toBasicMesh();
 
+        /**
+         * Like toBasicMesh but with 10 bytes per vertex instead of 52: positions quantized to 16
+         * bits within the bounds of the volume, with the scale in the model matrix, and normals
+         * octahedron encoded as two 16-bit snorms. There are no texture coordinates or colors,
+         * renderers have to decode the normals, see encodeOctahedron.
+         */
+        std::shared_ptr<Mesh> toCompactMesh();
+
+        /**
+         * Sets the normal of every vertex to the gradient of the volume, by central differences
+         * at the two DataPoints of its edge interpolated like the position of the vertex. Runs
+         * in parallel over the vertices once the mesh is complete.
+         */
+        void computeGradientNormals(const VolumeRAM& volume, float iso);
+
+        /**
+         * Sets the normal of every vertex to the sum of the normals of its triangles, like
+         * addTriangle does with faceNormals.
+         */
+        void computeFaceNormals();
+
+        /**
+         * Moves every vertex along its edge to where the volume crosses iso. For a mesh of
+         * another iso value that no DataPoint of its cells lies between, the cells then have the
+         * same cases and the mesh is the one of iso. Normals are left unchanged.
+         */
+        void reinterpolate(const VolumeRAM& volume, float iso);
+
+        bool empty() const { return indices_.empty(); }
+
+        /**
+         * Concatenates the meshes of bricks of MinMaxBricks of the same volume, in order.
+         * Vertices on an edge within a face between two bricks are welded with the first vertex
+         * of that edge and their normals are summed. The result does not support addVertex.
+         * There must be at least one brick.
+         */
+        static MeshHelper merge(const std::vector<const MeshHelper*>& bricks);
+
     private:
-        std::unordered_map<std::pair<size_t, size_t>, size_t, HashFunc> edgeToVertex_;
+        void addFaceNormal(size_t i0, size_t i1, size_t i2);
+
+        std::shared_ptr<const Volume> volume_;
+        bool faceNormals_;
         std::vector<BasicMesh::Vertex> vertices_;
-        std::shared_ptr<BasicMesh> mesh_;
-        std::shared_ptr<IndexBufferRAM> indexBuffer_;
+        std::vector<std::pair<size_t, size_t>> vertexEdges_;  // The edge of each vertex
+        std::vector<std::uint32_t> indices_;
+    };
+
+    /**
+     * Minimum and maximum value of each brick of brickSize^3 cells, over all DataPoints of its
+     * cells. Bricks at the far sides of the volume may be smaller.
+     */
+    struct MinMaxBricks {
+        static constexpr size_t brickSize = 8;
+
+        explicit MinMaxBricks(const VolumeRAM& volume);
+
+        // True if cells of the brick can intersect the iso surface of any of the iso values
+        bool active(size3_t brick, const std::vector<float>& isoValues) const {
+            return active(brick.x + numBricks.x * (brick.y + numBricks.y * brick.z), isoValues);
+        }
+        bool active(size_t brick, const std::vector<float>& isoValues) const {
+            return std::any_of(isoValues.begin(), isoValues.end(),
+                               [&](float iso) { return active(brick, iso); });
+        }
+        bool active(size_t brick, float iso) const {
+            return minMax[brick].x < iso && minMax[brick].y >= iso;
+        }
+
+        // Position of the brick with the given index in minMax
+        size3_t brick(size_t index) const {
+            return {index % numBricks.x, (index / numBricks.x) % numBricks.y,
+                    index / (numBricks.x * numBricks.y)};
+        }
+
+        size3_t numBricks;
+        std::vector<vec2> minMax;
     };
 
     MarchingTetrahedra();
@@ -81,8 +214,18 @@ public:
     #define ENABLE_DATAPOINT_POS_TEST 0
     static vec3 calculateDataPointPos(size3_t posVolume, ivec3 posCell, ivec3 dims);
 
-    // ADDED FUNCITON DURING LAB 2   
-    void createTriangle(const TriEdge& side0, const TriEdge& side1, const TriEdge& side2, float iso, const MarchingTetrahedra::Tetrahedra& tetra, MarchingTetrahedra::MeshHelper &mesh);
+    /**
+     * Extracts the iso surfaces of all cells with begin <= pos < end, skipping inactive bricks.
+     * The cells are visited once for all iso values, the surface of isoValues[i] is added to
+     * meshes[i]. edges is cleared and used to share the vertices of edges, it has to be made for
+     * the decomposition and at least isoValues.size() iso values. Returns early, between layers
+     * of cells, once stop is set.
+     */
+    static void extractSurface(const VolumeRAM& volume, size3_t begin, size3_t end,
+                               const std::vector<float>& isoValues,
+                               CellDecomposition decomposition, const MinMaxBricks& bricks,
+                               std::vector<MeshHelper>& meshes, EdgeSlices& edges,
+                               const TNM067::BackgroundJob::Stop& stop);
     
     virtual void process() override;
 
@@ -92,8 +235,97 @@ public:
 private:
     VolumeInport volume_;
     MeshOutport mesh_;
+    DataOutport<std::vector<std::shared_ptr<Mesh>>> meshes_;  // One mesh per iso value
 
     FloatProperty isoValue_;
+    BoolProperty parallel_;  // Extract bricks of cells in the thread pool
+    TemplateOptionProperty<CellDecomposition> decomposition_;
+    BoolProperty gradientNormals_;  // Vertex normals from the volume gradient
+    BoolProperty compactOutput_;    // Output meshes from MeshHelper::toCompactMesh
+    /**
+     * Extract on every previewStride_-th DataPoint first, then at full resolution. 1 disables.
+     * Small volumes, and changes of the iso value that only affect few cells, are extracted at
+     * full resolution directly.
+     */
+    IntSizeTProperty previewStride_;
+
+    // Extract the surfaces of isoValues_ in one pass over the volume, output on meshes_
+    BoolProperty multipleIsoValues_;
+    IntSizeTProperty numIsoValues_;
+    std::array<FloatProperty, 20> isoValues_;
+
+    /**
+     * The surface of an iso value from the last extraction, as one mesh per brick of
+     * MinMaxBricks that it crosses, and the output mesh made of them. The brick meshes have face
+     * normals unless the output has gradient normals.
+     */
+    struct BrickSurface {
+        float iso;
+        std::vector<std::pair<size_t, MeshHelper>> bricks;  // By ascending brick index
+        std::shared_ptr<Mesh> mesh;
+
+        // The mesh of the brick, or nullptr if the surface does not cross it
+        const MeshHelper* find(size_t brick) const;
+    };
+
+    /**
+     * The surfaces of the last extraction. When the iso value changes, the next extraction with
+     * the same decomposition starts from the surface with the closest iso value: only the bricks
+     * with a DataPoint between the two iso values are extracted again, the meshes of the others
+     * are moved to the new iso value along their edges and all are merged. The output mesh is
+     * reused as is if the iso value and output settings are the same. Takes about as much memory
+     * as the output meshes.
+     */
+    struct MeshCache {
+        CellDecomposition decomposition;
+        bool gradientNormals;
+        bool compactOutput;
+        std::vector<std::shared_ptr<const BrickSurface>> surfaces;
+
+        std::shared_ptr<const BrickSurface> closest(float iso) const;
+    };
+
+    // The property values an extraction runs with
+    struct Settings {
+        std::vector<float> isoValues;
+        bool multipleIsoValues;
+        bool parallel;
+        CellDecomposition decomposition;
+        bool gradientNormals;
+        bool compactOutput;
+    };
+
+    // Caches of the current volume, used by one extraction at a time
+    struct Cache {
+        std::optional<MinMaxBricks> bricks;  // Built on first use
+        std::optional<MeshCache> meshes;
+
+        /**
+         * Upper bound of the cells extract visits for settings: the cells of the bricks that a
+         * surface crosses, except those whose value range shows that the cached surface can be
+         * moved to the new iso value. The bricks have to be built.
+         */
+        size_t cellsToExtract(const Settings& settings) const;
+    };
+
+    /**
+     * Extracts the surfaces of settings.isoValues, one mesh per iso value. Runs in the
+     * background, returns no meshes if stopped.
+     */
+    static std::vector<std::shared_ptr<Mesh>> extract(std::shared_ptr<const Volume> volume,
+                                                      const VolumeRAM& volumeRAM,
+                                                      const Settings& settings, Cache& cache,
+                                                      const TNM067::BackgroundJob::Stop& stop);
+
+    std::shared_ptr<Cache> cache_;  // Replaced when the volume changes
+    TNM067::BackgroundJob job_;
+    // The meshes of the last finished extraction
+    struct Result {
+        std::vector<std::shared_ptr<Mesh>> meshes;
+        bool multipleIsoValues;
+        bool preview;  // Extracted with previewStride_, to be refined
+    };
+    std::optional<Result> finished_;
 };
 
 }  // namespace inviwo
@@ -0,0 +1,258 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <benchmark/benchmark.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/processors/hydrogengenerator.h>
+#include <modules/tnm067lab2/processors/marchingtetrahedra.h>
+#include <inviwo/core/common/inviwoapplication.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/util/indexmapper.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace inviwo {
+
+    namespace {
+
+        // The volume HydrogenGenerator outputs for the given size
+        std::shared_ptr<Volume> hydrogenVolume(size_t size) {
+            auto volume = std::make_shared<Volume>(size3_t(size), DataFloat32::get());
+            auto ram = volume->getEditableRepresentation<VolumeRAM>();
+            auto data = static_cast<float*>(ram->getData());
+            util::IndexMapper3D index(ram->getDimensions());
+            float min = std::numeric_limits<float>::max();
+            float max = std::numeric_limits<float>::lowest();
+            for (size_t z = 0; z < size; ++z) {
+                for (size_t y = 0; y < size; ++y) {
+                    for (size_t x = 0; x < size; ++x) {
+                        // As HydrogenGenerator::idTOCartesian
+                        const vec3 cartesian =
+                            vec3(x, y, z) / static_cast<float>(size - 1) * 36.0f - 18.0f;
+                        const auto value =
+                            static_cast<float>(HydrogenGenerator::eval(cartesian));
+                        data[index(size3_t(x, y, z))] = value;
+                        min = std::min(min, value);
+                        max = std::max(max, value);
+                    }
+                }
+            }
+            volume->dataMap_.dataRange = volume->dataMap_.valueRange = dvec2(min, max);
+            return volume;
+        }
+
+        // range(1) is the iso value in per mille of the value range
+        float isoValue(const Volume& volume, const benchmark::State& state) {
+            const dvec2 range = volume.dataMap_.valueRange;
+            return static_cast<float>(range.x + (range.y - range.x) * state.range(1) / 1000.0);
+        }
+
+        /**
+         * The extraction of the original MarchingTetrahedra::process, for comparison: values
+         * through VolumeRAM::getAsDouble, a vector of tetrahedra per cell, the case by pow and
+         * shared vertices looked up in an unordered_map by edge.
+         */
+        struct BaselineMesh {
+            struct HashFunc {
+                size_t max;
+                size_t operator()(std::pair<size_t, size_t> p) const {
+                    return std::hash<size_t>{}(p.first + p.second * max);
+                }
+            };
+
+            explicit BaselineMesh(size_t max) : edgeToVertex(0, HashFunc{max}) {}
+
+            std::uint32_t addVertex(vec3 pos, size_t i, size_t j) {
+                if (j < i) std::swap(i, j);
+                auto [it, inserted] = edgeToVertex.try_emplace({i, j}, positions.size());
+                if (inserted) {
+                    positions.push_back(pos);
+                    normals.push_back(vec3(0.0f));
+                }
+                return static_cast<std::uint32_t>(it->second);
+            }
+
+            void addTriangle(std::uint32_t i0, std::uint32_t i1, std::uint32_t i2) {
+                indices.insert(indices.end(), {i0, i1, i2});
+                const vec3 n = glm::normalize(
+                    glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+                normals[i0] += n;
+                normals[i1] += n;
+                normals[i2] += n;
+            }
+
+            std::unordered_map<std::pair<size_t, size_t>, size_t, HashFunc> edgeToVertex;
+            std::vector<vec3> positions;
+            std::vector<vec3> normals;
+            std::vector<std::uint32_t> indices;
+        };
+
+        void baselineExtract(const VolumeRAM& volume, float iso, BaselineMesh& mesh) {
+            using DataPoint = MarchingTetrahedra::DataPoint;
+            using Tetrahedra = MarchingTetrahedra::Tetrahedra;
+
+            const auto& dims = volume.getDimensions();
+            util::IndexMapper3D indexInVolume(dims);
+
+            const static size_t tetrahedraIds[6][4] = {{0, 1, 2, 5}, {1, 3, 2, 5}, {3, 2, 5, 7},
+                                                       {0, 2, 4, 5}, {6, 4, 2, 5}, {6, 7, 5, 2}};
+            // The triangles of the switch over the 16 cases, as edges between DataPoints of the
+            // tetrahedron
+            using Edge = std::array<size_t, 2>;
+            using Triangle = std::array<Edge, 3>;
+            const static std::array<std::vector<Triangle>, 16> cases{{
+                {},
+                {{{{0, 1}, {0, 2}, {0, 3}}}},
+                {{{{1, 0}, {1, 3}, {1, 2}}}},
+                {{{{0, 3}, {1, 3}, {1, 2}}}, {{{0, 3}, {1, 2}, {0, 2}}}},
+                {{{{2, 0}, {2, 1}, {2, 3}}}},
+                {{{{0, 3}, {0, 1}, {1, 2}}}, {{{0, 3}, {1, 2}, {2, 3}}}},
+                {{{{0, 2}, {0, 1}, {1, 3}}}, {{{0, 2}, {1, 3}, {3, 2}}}},
+                {{{{1, 3}, {2, 3}, {0, 3}}}},
+                {{{{1, 3}, {0, 3}, {2, 3}}}},
+                {{{{0, 2}, {1, 3}, {0, 1}}}, {{{0, 2}, {3, 2}, {1, 3}}}},
+                {{{{0, 3}, {1, 2}, {0, 1}}}, {{{0, 3}, {2, 3}, {1, 2}}}},
+                {{{{2, 0}, {2, 3}, {2, 1}}}},
+                {{{{0, 3}, {1, 2}, {1, 3}}}, {{{0, 3}, {0, 2}, {1, 2}}}},
+                {{{{1, 0}, {1, 2}, {1, 3}}}},
+                {{{{0, 1}, {0, 3}, {0, 2}}}},
+                {},
+            }};
+
+            size3_t pos{};
+            for (pos.z = 0; pos.z < dims.z - 1; ++pos.z) {
+                for (pos.y = 0; pos.y < dims.y - 1; ++pos.y) {
+                    for (pos.x = 0; pos.x < dims.x - 1; ++pos.x) {
+                        MarchingTetrahedra::Cell c;
+                        for (size_t z{0}; z < 2; ++z) {
+                            for (size_t y{0}; y < 2; ++y) {
+                                for (size_t x{0}; x < 2; ++x) {
+                                    const ivec3 posCell(x, y, z);
+                                    const size3_t posGlobal = pos + size3_t(posCell);
+                                    c.dataPoints[MarchingTetrahedra::calculateDataPointIndexInCell(
+                                        posCell)] = DataPoint{
+                                        MarchingTetrahedra::calculateDataPointPos(pos, posCell,
+                                                                                  dims),
+                                        static_cast<float>(volume.getAsDouble(posGlobal)),
+                                        indexInVolume(posGlobal)};
+                                }
+                            }
+                        }
+
+                        std::vector<Tetrahedra> tetrahedras;
+                        for (size_t t{0}; t < 6; ++t) {
+                            Tetrahedra tetra{};
+                            for (size_t p{0}; p < 4; ++p) {
+                                tetra.dataPoints[p] = c.dataPoints[tetrahedraIds[t][p]];
+                            }
+                            tetrahedras.push_back(tetra);
+                        }
+
+                        for (const Tetrahedra& tetra : tetrahedras) {
+                            int caseId = 0;
+                            for (size_t p{0}; p < 4; ++p) {
+                                if (tetra.dataPoints[p].value < iso) {
+                                    caseId +=
+                                        static_cast<int>(glm::pow(2.0, static_cast<double>(p)));
+                                }
+                            }
+                            for (const auto& triangle : cases[caseId]) {
+                                std::uint32_t vertices[3];
+                                for (size_t e = 0; e < 3; ++e) {
+                                    const auto& origin = tetra.dataPoints[triangle[e][0]];
+                                    const auto& dest = tetra.dataPoints[triangle[e][1]];
+                                    const vec3 p = origin.pos + (dest.pos - origin.pos) *
+                                                                    ((iso - origin.value) /
+                                                                     (dest.value - origin.value));
+                                    vertices[e] = mesh.addVertex(p, origin.index, dest.index);
+                                }
+                                mesh.addTriangle(vertices[0], vertices[1], vertices[2]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        void setCounters(benchmark::State& state, size_t size) {
+            const auto cells = static_cast<int64_t>((size - 1) * (size - 1) * (size - 1));
+            state.SetItemsProcessed(state.iterations() * cells);
+            state.counters["cells/s"] = benchmark::Counter(
+                static_cast<double>(state.iterations() * cells), benchmark::Counter::kIsRate);
+        }
+
+        void baseline(benchmark::State& state) {
+            const auto size = static_cast<size_t>(state.range(0));
+            const auto volume = hydrogenVolume(size);
+            const auto& ram = *volume->getRepresentation<VolumeRAM>();
+            const float iso = isoValue(*volume, state);
+            for (auto _ : state) {
+                BaselineMesh mesh(size * size * size);
+                baselineExtract(ram, iso, mesh);
+                benchmark::DoNotOptimize(mesh.indices.data());
+            }
+            setCounters(state, size);
+        }
+
+        /**
+         * MarchingTetrahedra::extractSurface of all cells on the calling thread, with the
+         * min/max bricks built once like the processor caches them per volume.
+         */
+        void extractSurface(benchmark::State& state,
+                            MarchingTetrahedra::CellDecomposition decomposition) {
+            const auto size = static_cast<size_t>(state.range(0));
+            const auto volume = hydrogenVolume(size);
+            const auto& ram = *volume->getRepresentation<VolumeRAM>();
+            const std::vector<float> isoValues{isoValue(*volume, state)};
+            const MarchingTetrahedra::MinMaxBricks bricks(ram);
+            const TNM067::BackgroundJob::Stop stop{false};
+            MarchingTetrahedra::EdgeSlices edges(ram.getDimensions(), decomposition, 1);
+            for (auto _ : state) {
+                std::vector<MarchingTetrahedra::MeshHelper> meshes{
+                    MarchingTetrahedra::MeshHelper(volume)};
+                MarchingTetrahedra::extractSurface(ram, size3_t(0), size3_t(size - 1), isoValues,
+                                                   decomposition, bricks, meshes, edges, stop);
+                benchmark::DoNotOptimize(meshes.data());
+            }
+            setCounters(state, size);
+        }
+
+        // Volume sizes, and iso values at 50% and 1% of the value range
+        void arguments(benchmark::internal::Benchmark* b) {
+            for (int64_t size : {64, 128}) {
+                for (int64_t iso : {500, 10}) b->Args({size, iso});
+            }
+            b->ArgNames({"size", "iso"})->Unit(benchmark::kMillisecond);
+        }
+
+    }  // namespace
+
+    BENCHMARK(baseline)->Apply(arguments);
+    BENCHMARK_CAPTURE(extractSurface, sixTetrahedra,
+                      MarchingTetrahedra::CellDecomposition::SixTetrahedra)
+        ->Apply(arguments);
+    BENCHMARK_CAPTURE(extractSurface, fiveTetrahedra,
+                      MarchingTetrahedra::CellDecomposition::FiveTetrahedra)
+        ->Apply(arguments);
+    BENCHMARK_CAPTURE(extractSurface, cubes, MarchingTetrahedra::CellDecomposition::Cubes)
+        ->Apply(arguments);
+
+}  // namespace inviwo
+
+// MinMaxBricks is built with TNM067::parallelFor, which uses the thread pool of the application
+int main(int argc, char** argv) {
+    inviwo::InviwoApplication app("Inviwo-Benchmark-TNM067Lab2");
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/processors/marchingtetrahedra.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+#include <inviwo/core/datastructures/buffer/bufferram.h>
+#include <inviwo/core/util/indexmapper.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace inviwo {
+
+    namespace {
+
+        using CellDecomposition = MarchingTetrahedra::CellDecomposition;
+
+        /**
+         * Random values in [0, 1) with a border of ones, so the iso surfaces of values below one
+         * are closed. The size is not a multiple of the brick size, to have partial bricks.
+         */
+        std::shared_ptr<Volume> randomVolume(size3_t dims, unsigned seed) {
+            auto ram = std::make_shared<VolumeRAMPrecision<float>>(dims);
+            auto data = ram->getDataTyped();
+            util::IndexMapper3D index(dims);
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> value(0.0f, 1.0f);
+            for (size_t z = 0; z < dims.z; ++z) {
+                for (size_t y = 0; y < dims.y; ++y) {
+                    for (size_t x = 0; x < dims.x; ++x) {
+                        const bool border = x == 0 || y == 0 || z == 0 || x == dims.x - 1 ||
+                                            y == dims.y - 1 || z == dims.z - 1;
+                        data[index(size3_t(x, y, z))] = border ? 1.0f : value(rng);
+                    }
+                }
+            }
+            return std::make_shared<Volume>(ram);
+        }
+
+        const std::vector<std::uint32_t>& indices(const BasicMesh& mesh) {
+            const auto& buffer = mesh.getIndexBuffers().front().second;
+            return buffer->getRAMRepresentation()->getDataContainer();
+        }
+
+        const std::vector<vec3>& positions(const BasicMesh& mesh) {
+            return mesh.getVertices()->getRAMRepresentation()->getDataContainer();
+        }
+
+        /**
+         * Every edge of a closed, consistently wound mesh is used by exactly two triangles, once
+         * in each direction.
+         */
+        void expectWatertight(MarchingTetrahedra::MeshHelper& helper) {
+            auto mesh = helper.toBasicMesh();
+            ASSERT_EQ(mesh->getIndexBuffers().size(), 1u);
+            const auto& indices = inviwo::indices(*mesh);
+            ASSERT_EQ(indices.size() % 3, 0u);
+            EXPECT_FALSE(indices.empty());
+
+            // Number of uses of each directed edge
+            std::map<std::pair<std::uint32_t, std::uint32_t>, int> edges;
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                for (size_t e = 0; e < 3; ++e) {
+                    ++edges[{indices[t + e], indices[t + (e + 1) % 3]}];
+                }
+            }
+            for (const auto& [edge, count] : edges) {
+                EXPECT_EQ(count, 1) << "Edge " << edge.first << " " << edge.second;
+                const auto opposite = edges.find({edge.second, edge.first});
+                EXPECT_TRUE(opposite != edges.end() && opposite->second == 1)
+                    << "Edge " << edge.first << " " << edge.second;
+            }
+        }
+
+        // Extracts each brick of MinMaxBricks on its own, like the processor
+        std::vector<std::vector<MarchingTetrahedra::MeshHelper>> extractBricks(
+            std::shared_ptr<const Volume> volume, const std::vector<float>& isoValues,
+            CellDecomposition decomposition, const MarchingTetrahedra::MinMaxBricks& bricks) {
+            constexpr size_t brickSize = MarchingTetrahedra::MinMaxBricks::brickSize;
+            const auto& ram = *volume->getRepresentation<VolumeRAM>();
+            const size3_t numCells = ram.getDimensions() - size3_t(1);
+            const TNM067::BackgroundJob::Stop stop{false};
+            MarchingTetrahedra::EdgeSlices edges(ram.getDimensions(), decomposition,
+                                                 isoValues.size());
+
+            const std::vector<MarchingTetrahedra::MeshHelper> empty(
+                isoValues.size(), MarchingTetrahedra::MeshHelper(volume));
+            std::vector<std::vector<MarchingTetrahedra::MeshHelper>> meshes(bricks.minMax.size(),
+                                                                            empty);
+            for (size_t b = 0; b < bricks.minMax.size(); ++b) {
+                const size3_t begin = bricks.brick(b) * brickSize;
+                MarchingTetrahedra::extractSurface(ram, begin,
+                                                   glm::min(begin + size3_t(brickSize), numCells),
+                                                   isoValues, decomposition, bricks, meshes[b],
+                                                   edges, stop);
+            }
+            return meshes;
+        }
+
+        MarchingTetrahedra::MeshHelper merge(
+            const std::vector<std::vector<MarchingTetrahedra::MeshHelper>>& bricks, size_t k) {
+            std::vector<const MarchingTetrahedra::MeshHelper*> parts;
+            for (const auto& brick : bricks) parts.push_back(&brick[k]);
+            return MarchingTetrahedra::MeshHelper::merge(parts);
+        }
+
+        /**
+         * Extracts the iso surfaces of random volumes in one range of cells, and per brick with
+         * the bricks merged like the processor does.
+         */
+        void testWatertight(CellDecomposition decomposition) {
+            const size3_t dims{13, 11, 21};
+            const std::vector<float> isoValues{0.3f, 0.5f, 0.7f};
+            const TNM067::BackgroundJob::Stop stop{false};
+
+            for (unsigned seed = 0; seed < 4; ++seed) {
+                const auto volume = randomVolume(dims, seed);
+                const auto& ram = *volume->getRepresentation<VolumeRAM>();
+                const MarchingTetrahedra::MinMaxBricks bricks(ram);
+                const MarchingTetrahedra::MeshHelper emptyMesh(volume);
+                MarchingTetrahedra::EdgeSlices edges(dims, decomposition, isoValues.size());
+
+                std::vector<MarchingTetrahedra::MeshHelper> meshes(isoValues.size(), emptyMesh);
+                MarchingTetrahedra::extractSurface(ram, size3_t(0), dims - size3_t(1), isoValues,
+                                                   decomposition, bricks, meshes, edges, stop);
+                for (auto& mesh : meshes) expectWatertight(mesh);
+
+                const auto brickMeshes = extractBricks(volume, isoValues, decomposition, bricks);
+                for (size_t k = 0; k < isoValues.size(); ++k) {
+                    auto merged = merge(brickMeshes, k);
+                    expectWatertight(merged);
+                }
+            }
+        }
+
+        /**
+         * Moves the surface of one iso value to another along the edges, in the bricks where no
+         * DataPoint lies between the two, which has to give the surface extracted for the other
+         * iso value.
+         */
+        void testReinterpolate(CellDecomposition decomposition) {
+            const size3_t dims{13, 11, 21};
+            const float from = 0.5f;
+            const float to = 0.52f;
+
+            for (unsigned seed = 0; seed < 4; ++seed) {
+                const auto volume = randomVolume(dims, seed);
+                const auto& ram = *volume->getRepresentation<VolumeRAM>();
+                const auto data =
+                    static_cast<const VolumeRAMPrecision<float>&>(ram).getDataTyped();
+                const MarchingTetrahedra::MinMaxBricks bricks(ram);
+                const auto before = extractBricks(volume, {from}, decomposition, bricks);
+                const auto after = extractBricks(volume, {to}, decomposition, bricks);
+
+                size_t moved = 0;
+                for (size_t b = 0; b < bricks.minMax.size(); ++b) {
+                    const size3_t begin =
+                        bricks.brick(b) * MarchingTetrahedra::MinMaxBricks::brickSize;
+                    const size3_t end = glm::min(
+                        begin + size3_t(MarchingTetrahedra::MinMaxBricks::brickSize + 1), dims);
+                    util::IndexMapper3D index(dims);
+                    bool between = false;
+                    for (size_t z = begin.z; z < end.z; ++z) {
+                        for (size_t y = begin.y; y < end.y; ++y) {
+                            for (size_t x = begin.x; x < end.x; ++x) {
+                                const float value = data[index(size3_t(x, y, z))];
+                                between |= value >= from && value < to;
+                            }
+                        }
+                    }
+                    if (between) continue;
+
+                    auto mesh = before[b][0];
+                    mesh.reinterpolate(ram, to);
+                    auto expected = after[b][0];
+                    const auto result = mesh.toBasicMesh();
+                    const auto reference = expected.toBasicMesh();
+                    const auto& p = positions(*result);
+                    const auto& q = positions(*reference);
+                    ASSERT_EQ(p.size(), q.size());
+                    for (size_t v = 0; v < p.size(); ++v) {
+                        for (int axis = 0; axis < 3; ++axis) {
+                            EXPECT_NEAR(p[v][axis], q[v][axis], 1e-5f);
+                        }
+                    }
+                    EXPECT_EQ(indices(*result), indices(*reference));
+                    if (!p.empty()) ++moved;
+                }
+                EXPECT_GT(moved, 0u);
+            }
+        }
+
+    }  // namespace
+
+    TEST(MarchingTetrahedraWatertight, SixTetrahedra) {
+        testWatertight(CellDecomposition::SixTetrahedra);
+    }
+    TEST(MarchingTetrahedraWatertight, FiveTetrahedra) {
+        testWatertight(CellDecomposition::FiveTetrahedra);
+    }
+    TEST(MarchingTetrahedraWatertight, Cubes) { testWatertight(CellDecomposition::Cubes); }
+
+    TEST(MarchingTetrahedraReinterpolate, SixTetrahedra) {
+        testReinterpolate(CellDecomposition::SixTetrahedra);
+    }
+    TEST(MarchingTetrahedraReinterpolate, FiveTetrahedra) {
+        testReinterpolate(CellDecomposition::FiveTetrahedra);
+    }
+    TEST(MarchingTetrahedraReinterpolate, Cubes) { testReinterpolate(CellDecomposition::Cubes); }
+
+}  // namespace inviwo